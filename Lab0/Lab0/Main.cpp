@@ -2,6 +2,9 @@
 #include <stdlib.h>
 #include <crtdbg.h>
 #include <stdexcept>
+#include <atomic>
+#include <thread>
+#include <vector>
 #include <iostream>
 #include <gtest/gtest.h>
 using namespace std;
@@ -22,17 +25,50 @@ bool isEqualHeapStates(const _CrtMemState& memstate1, const _CrtMemState& memsta
 
 class RNA {
 private:
+	// Packed nucleotides. Copies of an RNA share them until one of the copies is changed.
+	// The count is atomic, so copies sharing a storage may live on different threads; the last
+	// release sees every write made through the storage before it deletes it.
+	struct Storage {
+		atomic<size_t> references;
+		unsigned int* words;
+		explicit Storage(size_t size) : references(1), words(new unsigned int[size]) {}
+		~Storage() {
+			delete[] words;
+		}
+	};
+
 	size_t length;
 	size_t storageSize;
-	unsigned int* storage;
+	Storage* storage;
+
+	void release() {
+		if (storage != nullptr && storage->references.fetch_sub(1, memory_order_acq_rel) == 1) {
+			delete storage;
+		}
+		storage = nullptr;
+	}
+
+	// Gives this RNA its own copy of the storage before it is written
+	void detach() {
+		if (storage == nullptr || storage->references.load(memory_order_acquire) == 1) {
+			return;
+		}
+		Storage* ownStorage = new Storage(storageSize);
+		copyArray<unsigned int>(storage->words, ownStorage->words, storageSize);
+		// The other copies may have been released meanwhile, leaving this one the last
+		release();
+		storage = ownStorage;
+	}
 
 	void resize(size_t newSize) {
 		if (newSize == storageSize){
 			return;
 		}
-		unsigned int* newStorage = new unsigned int[newSize];
-		copyArray<unsigned int>(storage, newStorage, storageSize < newSize ? storageSize : newSize);
-		delete[] storage;
+		Storage* newStorage = new Storage(newSize);
+		if (storage != nullptr) {
+			copyArray<unsigned int>(storage->words, newStorage->words, storageSize < newSize ? storageSize : newSize);
+		}
+		release();
 		storageSize = newSize;
 		storage = newStorage;
 	}
@@ -60,7 +96,7 @@ private:
 		}
 		size_t bitPackIndex = nucleotideIndex / (4 * sizeof(unsigned int));
 		size_t bitPairIndex = nucleotideIndex % (4 * sizeof(unsigned int));
-		unsigned int bitPack = storage[bitPackIndex];
+		unsigned int bitPack = storage->words[bitPackIndex];
 		return Nucleotide((bitPack >> (2*bitPairIndex))&mask);
 	}
 
@@ -68,10 +104,11 @@ private:
 		if (nucleotideIndex >= length) {
 			throw out_of_range("inappropriate index");
 		}
+		detach();
 		size_t bitPackIndex = nucleotideIndex / (4 * sizeof(unsigned int));
 		size_t bitPairIndex = nucleotideIndex % (4 * sizeof(unsigned int));
-		unsigned int bitPack = storage[bitPackIndex];
-		storage[bitPackIndex] = (bitPack&(~(mask << (2*bitPairIndex)))) | ((unsigned int(newValue)) << (2*bitPairIndex));
+		unsigned int bitPack = storage->words[bitPackIndex];
+		storage->words[bitPackIndex] = (bitPack&(~(mask << (2*bitPairIndex)))) | ((unsigned int(newValue)) << (2*bitPairIndex));
 	}
 
 	class StorageAccessor {
@@ -96,9 +133,10 @@ private:
 
 public:
 	RNA() : storageSize(0), length(0), storage(nullptr) {}
-	RNA(const RNA& rna): storageSize(rna.storageSize), length(rna.length) {
-		storage = new unsigned int[rna.storageSize];
-		copyArray<unsigned int>(rna.storage, storage, storageSize);
+	RNA(const RNA& rna): storageSize(rna.storageSize), length(rna.length), storage(rna.storage) {
+		if (storage != nullptr) {
+			++storage->references;
+		}
 	}
 	RNA(RNA&& rna) noexcept : storage(rna.storage), storageSize(rna.storageSize), length(rna.length) {
 		rna.storage = nullptr;
@@ -136,25 +174,51 @@ public:
 	bool operator!= (const RNA& rvalue) const {
 		return !operator==(rvalue);
 	}
+	// Compares whole words, without building the complement
+	bool isComplementary(const RNA& rvalue) const {
+		if (length != rvalue.length) {
+			return false;
+		}
+		size_t nucleotidesPerPack = 4 * sizeof(unsigned int);
+		size_t fullPacks = length / nucleotidesPerPack;
+		for (size_t i = 0; i < fullPacks; ++i) {
+			if (storage->words[i] != ~rvalue.storage->words[i]) {
+				return false;
+			}
+		}
+		size_t restLength = length % nucleotidesPerPack;
+		if (restLength == 0) {
+			return true;
+		}
+		unsigned int restMask = (1u << (2 * restLength)) - 1;
+		return ((storage->words[fullPacks] ^ ~rvalue.storage->words[fullPacks]) & restMask) == 0;
+	}
 	RNA operator~() const {
-		RNA result(*this);
-		for (int i = 0; i < storageSize; ++i) {
-			result.storage[i] = ~(result.storage[i]);
+		RNA result;
+		result.length = length;
+		result.storageSize = storageSize;
+		if (storage != nullptr) {
+			result.storage = new Storage(storageSize);
+			for (int i = 0; i < storageSize; ++i) {
+				result.storage->words[i] = ~(storage->words[i]);
+			}
 		}
 		return result;
 	}
 	RNA& operator=(const RNA& rvalue) {
 		if (this == &rvalue) return *this;
-		delete[] storage;
+		if (rvalue.storage != nullptr) {
+			++rvalue.storage->references;
+		}
+		release();
 		storageSize = rvalue.storageSize;
 		length = rvalue.length;
-		storage = new unsigned int[storageSize];
-		copyArray<unsigned int>(rvalue.storage, storage, storageSize);
+		storage = rvalue.storage;
 		return *this;
 	}
 	RNA& operator=(RNA&& rvalue) noexcept {
 		if (this == &rvalue) return *this;
-		delete[] storage;
+		release();
 		storageSize = rvalue.storageSize;
 		length = rvalue.length;
 		storage = rvalue.storage;
@@ -190,24 +254,46 @@ public:
 		fitSize();
 	}
 	~RNA() {
-		delete[] storage;
-		storage = nullptr;
+		release();
 	}
 };
 
+// Only the first strand is stored: the second one is its complement and is read through a view
 class DNA {
+private:
+	RNA rna1;
 public:
-	const RNA rna1;
-	const RNA rna2;
-	DNA(const RNA& rna1, const RNA& rna2): rna1(rna1), rna2(rna2) {
-		if (rna1 != ~rna2) {
+	// Shares the storage of the strand, so it stays valid after the DNA is gone
+	class ComplementView {
+	private:
+		const RNA rna;
+	public:
+		explicit ComplementView(const RNA& rna) : rna(rna) {}
+		size_t getLength() const {
+			return rna.getLength();
+		}
+		Nucleotide operator[] (size_t nucleotideIndex) const {
+			return Nucleotide(~rna[nucleotideIndex] & mask);
+		}
+		RNA toRNA() const {
+			return ~rna;
+		}
+	};
+	DNA(const RNA& rna1, const RNA& rna2): rna1(rna1) {
+		if (!rna1.isComplementary(rna2)) {
 			throw invalid_argument("rnas are not complementary, dna cannot be created");
 		}
 	}
+	const RNA& getRNA1() const {
+		return rna1;
+	}
+	ComplementView getRNA2() const {
+		return ComplementView(rna1);
+	}
 };
 ostream& operator<<(ostream& os, const DNA& dna) {
-	for (int i = 0; i < dna.rna1.getLength(); ++i) {
-		switch (dna.rna1[i]) {
+	for (int i = 0; i < dna.getRNA1().getLength(); ++i) {
+		switch (dna.getRNA1()[i]) {
 		case A:
 			os << "A-<>-U" << endl;
 			break;
@@ -270,6 +356,32 @@ namespace testingNamespace {
 		ASSERT_NE(rna1, ~rna2);
 		ASSERT_THROW(DNA(rna1, rna2), invalid_argument);
 	}
+	TEST_F(DNATestEnvironment, secondStrandIsComplementView) {
+		rna1[999] = G;
+		rna2[999] = C;
+		DNA dna(rna1, rna2);
+		ASSERT_EQ(dna.getRNA1(), rna1);
+		ASSERT_EQ(dna.getRNA2().getLength(), rna2.getLength());
+		for (int i = 0; i < rna2.getLength(); ++i) {
+			ASSERT_EQ(dna.getRNA2()[i], rna2[i]);
+		}
+		ASSERT_EQ(dna.getRNA2().toRNA(), rna2);
+	}
+	TEST_F(DNATestEnvironment, complementViewOutlivesDNA) {
+		rna2[0] = G;
+		rna1[0] = C;
+		DNA::ComplementView view = DNA(rna1, rna2).getRNA2();
+		ASSERT_EQ(view.getLength(), rna2.getLength());
+		ASSERT_EQ(view[0], G);
+		ASSERT_EQ(view.toRNA(), rna2);
+	}
+	TEST_F(DNATestEnvironment, noAllocationForDNA) {
+		_CrtMemState memState1, memState2;
+		_CrtMemCheckpoint(&memState1);
+		DNA dna(rna1, rna2);
+		_CrtMemCheckpoint(&memState2);
+		ASSERT_TRUE(isEqualHeapStates(memState1, memState2));
+	}
 
 	TEST_F(RNATestEnvironment, defaultConstructorTest){
 		RNA defaultRNA;
@@ -316,6 +428,24 @@ namespace testingNamespace {
 		}
 		ASSERT_EQ(RNA(A, 1000).getLength(), newRna.getLength());
 	}
+	TEST_F(RNATestEnvironment, copyOnWriteTest){
+		_CrtMemState memState1, memState2;
+		_CrtMemCheckpoint(&memState1);
+		RNA copiedRna(dummy);
+		RNA assignedRna;
+		assignedRna = dummy;
+		_CrtMemCheckpoint(&memState2);
+		ASSERT_TRUE(isEqualHeapStates(memState1, memState2));
+		copiedRna[0] = A;
+		_CrtMemCheckpoint(&memState2);
+		ASSERT_FALSE(isEqualHeapStates(memState1, memState2));
+		ASSERT_EQ(copiedRna[0], A);
+		ASSERT_EQ(dummy[0], C);
+		ASSERT_EQ(assignedRna[0], C);
+		assignedRna += G;
+		ASSERT_EQ(dummy.getLength(), 1000);
+		ASSERT_EQ(assignedRna[1000], G);
+	}
 	TEST_F(RNATestEnvironment, arrayBehaviourTest){
 		RNA ARna(A, 1000);
 		ASSERT_THROW(ARna[1000].operator Nucleotide(), out_of_range);
@@ -367,6 +497,28 @@ namespace testingNamespace {
 		newRna.trim(5);
 		ASSERT_EQ(newRna.getLength(), 5);
 	}
+	TEST_F(RNATestEnvironment, copiesOnSeveralThreadsTest){
+		_CrtMemState memState1, memState2;
+		_CrtMemCheckpoint(&memState1);
+		{
+			RNA shared(dummy);
+			vector<thread> threads;
+			for (int t = 0; t < 4; ++t) {
+				threads.emplace_back([&shared, t]() {
+					for (int i = 0; i < 10000; ++i) {
+						RNA copy(shared);
+						if (i % 2 == 0) copy[0] = Nucleotide(t);
+					}
+				});
+			}
+			for (thread& worker : threads) {
+				worker.join();
+			}
+			ASSERT_EQ(shared, dummy);
+		}
+		_CrtMemCheckpoint(&memState2);
+		ASSERT_TRUE(isEqualHeapStates(memState1, memState2));
+	}
 	TEST_F(RNATestEnvironment, memoryLeaksTest){
 		RNA* rna1;
 		_CrtMemState memState1, memState2;
@@ -0,0 +1,198 @@
+#pragma once
+#include <cstdint>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Up to 64x64 fields
+const int MAX_FIELD_CELLS = 4096;
+
+// The word must not be zero
+inline int lowestBitIndex(uint64_t word) {
+#if defined(_MSC_VER) && defined(_WIN64)
+	unsigned long index;
+	_BitScanForward64(&index, word);
+	return int(index);
+#elif defined(_MSC_VER)
+	// 32-bit targets only scan 32-bit words
+	unsigned long index;
+	if (_BitScanForward(&index, (unsigned long)(word))) return int(index);
+	_BitScanForward(&index, (unsigned long)(word >> 32));
+	return int(index) + 32;
+#else
+	return __builtin_ctzll(word);
+#endif
+}
+
+inline int bitCount(uint64_t word) {
+#ifdef _MSC_VER
+	// Not __popcnt64: it needs an x64 target and a CPU with the POPCNT instruction
+	word -= (word >> 1) & 0x5555555555555555ull;
+	word = (word & 0x3333333333333333ull) + ((word >> 2) & 0x3333333333333333ull);
+	word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+	return int((word * 0x0101010101010101ull) >> 56);
+#else
+	return __builtin_popcountll(word);
+#endif
+}
+
+// Set of field cells, cell index = y * width + x. The words live in place, so copies never
+// allocate. Only the words up to the highest cell ever set are in use and every operation stops
+// there: a 10x10 field costs two words whatever MAX_FIELD_CELLS is.
+class Bitboard {
+	static const int MAX_WORDS = (MAX_FIELD_CELLS + 63) / 64;
+	int wordCount;
+	uint64_t words[MAX_WORDS];
+	// Words past wordCount are zero without being stored
+	uint64_t word(int index) const {
+		return index < wordCount ? words[index] : 0;
+	}
+	void grow(int count) {
+		for (; wordCount < count; ++wordCount) words[wordCount] = 0;
+	}
+	// Combines the words both sets use and copies the rest from the longer one
+	template <class Operation>
+	Bitboard combined(const Bitboard& rvalue, Operation operation) const {
+		Bitboard result;
+		const Bitboard& longer = wordCount > rvalue.wordCount ? *this : rvalue;
+		int common = wordCount < rvalue.wordCount ? wordCount : rvalue.wordCount;
+		result.wordCount = longer.wordCount;
+		for (int i = 0; i < common; ++i) result.words[i] = operation(words[i], rvalue.words[i]);
+		for (int i = common; i < longer.wordCount; ++i) result.words[i] = longer.words[i];
+		return result;
+	}
+public:
+	Bitboard() : wordCount(0) {}
+	Bitboard(const Bitboard& source) : wordCount(source.wordCount) {
+		for (int i = 0; i < wordCount; ++i) words[i] = source.words[i];
+	}
+	Bitboard& operator=(const Bitboard& source) {
+		wordCount = source.wordCount;
+		for (int i = 0; i < wordCount; ++i) words[i] = source.words[i];
+		return *this;
+	}
+	bool test(int cell) const {
+		return ((word(cell / 64) >> (cell % 64)) & 1) != 0;
+	}
+	void set(int cell) {
+		grow(cell / 64 + 1);
+		words[cell / 64] |= uint64_t(1) << (cell % 64);
+	}
+	// Sets the cells first, first + 1, ..., first + count - 1
+	void setRange(int first, int count) {
+		if (count <= 0) return;
+		grow((first + count - 1) / 64 + 1);
+		while (count > 0) {
+			int offset = first % 64;
+			int taken = count < 64 - offset ? count : 64 - offset;
+			words[first / 64] |= (taken == 64 ? ~uint64_t(0) : ((uint64_t(1) << taken) - 1)) << offset;
+			first += taken;
+			count -= taken;
+		}
+	}
+	void reset(int cell) {
+		if (cell / 64 < wordCount) words[cell / 64] &= ~(uint64_t(1) << (cell % 64));
+	}
+	void flip(int cell) {
+		grow(cell / 64 + 1);
+		words[cell / 64] ^= uint64_t(1) << (cell % 64);
+	}
+	Bitboard operator&(const Bitboard& rvalue) const {
+		Bitboard result;
+		result.wordCount = wordCount < rvalue.wordCount ? wordCount : rvalue.wordCount;
+		for (int i = 0; i < result.wordCount; ++i) result.words[i] = words[i] & rvalue.words[i];
+		return result;
+	}
+	Bitboard& operator&=(const Bitboard& rvalue) {
+		if (rvalue.wordCount < wordCount) wordCount = rvalue.wordCount;
+		for (int i = 0; i < wordCount; ++i) words[i] &= rvalue.words[i];
+		return *this;
+	}
+	Bitboard operator|(const Bitboard& rvalue) const {
+		return combined(rvalue, [](uint64_t word1, uint64_t word2) { return word1 | word2; });
+	}
+	Bitboard operator^(const Bitboard& rvalue) const {
+		return combined(rvalue, [](uint64_t word1, uint64_t word2) { return word1 ^ word2; });
+	}
+	// Cells of this set that are not in rvalue
+	Bitboard andNot(const Bitboard& rvalue) const {
+		Bitboard result;
+		int common = wordCount < rvalue.wordCount ? wordCount : rvalue.wordCount;
+		result.wordCount = wordCount;
+		for (int i = 0; i < common; ++i) result.words[i] = words[i] & ~rvalue.words[i];
+		for (int i = common; i < wordCount; ++i) result.words[i] = words[i];
+		return result;
+	}
+	bool none() const {
+		for (int i = 0; i < wordCount; ++i) {
+			if (words[i] != 0) return false;
+		}
+		return true;
+	}
+	bool any() const {
+		return !none();
+	}
+	int count() const {
+		int result = 0;
+		for (int i = 0; i < wordCount; ++i) result += bitCount(words[i]);
+		return result;
+	}
+	// Index of the first cell >= from that belongs to the set, or -1
+	int next(int from) const {
+		for (int cell = from; cell < wordCount * 64; cell = (cell / 64 + 1) * 64) {
+			uint64_t bits = words[cell / 64] >> (cell % 64);
+			if (bits != 0) return cell + lowestBitIndex(bits);
+		}
+		return -1;
+	}
+	// The set moved towards lower indices: cell i of the result is cell i + count of this set
+	Bitboard shiftedDown(int count) const {
+		Bitboard result;
+		int wordShift = count / 64, bitShift = count % 64;
+		result.wordCount = wordCount > wordShift ? wordCount - wordShift : 0;
+		if (result.wordCount == 0) return result;
+		if (bitShift == 0) {
+			for (int i = 0; i < result.wordCount; ++i) result.words[i] = words[i + wordShift];
+			return result;
+		}
+		int last = result.wordCount - 1;
+		for (int i = 0; i < last; ++i) result.words[i] = (words[i + wordShift] >> bitShift) | (words[i + wordShift + 1] << (64 - bitShift));
+		result.words[last] = words[last + wordShift] >> bitShift;
+		return result;
+	}
+	// The set moved towards higher indices: cell i + count of the result is cell i of this set.
+	// Cells moved past MAX_FIELD_CELLS are dropped.
+	Bitboard shiftedUp(int count) const {
+		Bitboard result;
+		int wordShift = count / 64, bitShift = count % 64;
+		if (wordCount == 0) return result;
+		result.wordCount = wordCount + wordShift + (bitShift != 0 ? 1 : 0);
+		if (result.wordCount > MAX_WORDS) result.wordCount = MAX_WORDS;
+		for (int i = 0; i < result.wordCount; ++i) {
+			uint64_t bits = i - wordShift >= 0 ? word(i - wordShift) << bitShift : 0;
+			if (bitShift != 0 && i - wordShift - 1 >= 0) bits |= word(i - wordShift - 1) >> (64 - bitShift);
+			result.words[i] = bits;
+		}
+		return result;
+	}
+	// Index of the cell with the given rank among the cells of the set, or -1
+	int nth(int rank) const {
+		for (int i = 0; i < wordCount; ++i) {
+			uint64_t bits = words[i];
+			int wordBits = bitCount(bits);
+			if (rank >= wordBits) {
+				rank -= wordBits;
+				continue;
+			}
+			for (; rank > 0; --rank) bits &= bits - 1;
+			return i * 64 + lowestBitIndex(bits);
+		}
+		return -1;
+	}
+	bool operator==(const Bitboard& rvalue) const {
+		return (*this ^ rvalue).none();
+	}
+	bool operator!=(const Bitboard& rvalue) const {
+		return !operator==(rvalue);
+	}
+};
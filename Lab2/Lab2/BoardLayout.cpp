@@ -0,0 +1,93 @@
+#include "BoardLayout.h"
+#include "Bitboard.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+	const int MAX_LETTER_COLUMNS = 26;
+
+	int digitCount(int value) {
+		int count = 1;
+		for (; value >= 10; value /= 10) ++count;
+		return count;
+	}
+
+	void writeAt(std::vector<std::string>& frame, int x, int y, const std::string& text) {
+		frame[y].replace(x, text.length(), text);
+	}
+}
+
+BoardLayout loadLayout(const std::string& path) {
+	std::ifstream file(path);
+	if (!file.is_open()) throw std::runtime_error("cannot open layout " + path);
+	BoardLayout layout;
+	layout.fieldSize.X = layout.fieldSize.Y = 0;
+	bool inFrame = false;
+	std::string line;
+	while (std::getline(file, line)) {
+		if (!line.empty() && line[line.length() - 1] == '\r') line.erase(line.length() - 1);
+		if (inFrame) {
+			layout.frame.push_back(line);
+			continue;
+		}
+		std::istringstream words(line);
+		std::string keyword;
+		if (!(words >> keyword)) continue;
+		int x, y;
+		if (keyword == "frame") inFrame = true;
+		else if (keyword == "field" && words >> x >> y) {
+			if (x < 1 || y < 1 || x * y > MAX_FIELD_CELLS) throw std::runtime_error(path + ": the field is too large");
+			layout.fieldSize.X = short(x);
+			layout.fieldSize.Y = short(y);
+		}
+		else if (keyword == "at" && words >> x >> y && x >= 0 && y >= 0) {
+			COORD position;
+			position.X = short(x);
+			position.Y = short(y);
+			layout.fieldPositions.push_back(position);
+		}
+		else throw std::runtime_error(path + ": bad layout line \"" + line + "\"");
+	}
+	if (layout.fieldSize.X == 0 || layout.fieldPositions.empty() || layout.frame.empty()) {
+		throw std::runtime_error(path + ": a layout needs a field size, field positions and a frame");
+	}
+	return layout;
+}
+
+BoardLayout gridLayout(COORD fieldSize, int fieldCount) {
+	int labelWidth = digitCount(fieldSize.Y - 1);
+	bool letters = fieldSize.X <= MAX_LETTER_COLUMNS;
+	// Column numbers take a line for the tens and one for the units
+	int headerHeight = letters ? 1 : 2;
+	int blockWidth = labelWidth + fieldSize.X + 2 + labelWidth + 1;
+	int blockHeight = headerHeight + fieldSize.Y + 2 + 1;
+	int columns = 1;
+	while (columns * columns < fieldCount) ++columns;
+	int rows = (fieldCount + columns - 1) / columns;
+	BoardLayout layout;
+	layout.fieldSize = fieldSize;
+	layout.frame.assign(rows * blockHeight, std::string(columns * blockWidth, ' '));
+	for (int index = 0; index < fieldCount; ++index) {
+		int left = index % columns * blockWidth, top = index / columns * blockHeight;
+		COORD position;
+		position.X = short(left + labelWidth + 1);
+		position.Y = short(top + headerHeight + 1);
+		layout.fieldPositions.push_back(position);
+		for (int x = 0; x < fieldSize.X; ++x) {
+			if (letters) writeAt(layout.frame, position.X + x, top, std::string(1, char('A' + x)));
+			else {
+				if (x >= 10) writeAt(layout.frame, position.X + x, top, std::string(1, char('0' + x / 10)));
+				writeAt(layout.frame, position.X + x, top + 1, std::string(1, char('0' + x % 10)));
+			}
+		}
+		writeAt(layout.frame, position.X - 1, position.Y - 1, "/" + std::string(fieldSize.X, '-') + "\\");
+		for (int y = 0; y < fieldSize.Y; ++y) {
+			std::string label = std::to_string(y);
+			writeAt(layout.frame, position.X - 1 - int(label.length()), position.Y + y, label + "|");
+			writeAt(layout.frame, position.X + fieldSize.X, position.Y + y, "|" + label);
+		}
+		writeAt(layout.frame, position.X - 1, position.Y + fieldSize.Y, "\\" + std::string(fieldSize.X, '-') + "/");
+	}
+	return layout;
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "Terminal.h"
+
+// Where the fields of a game go on the screen: the frame picture around them and the top left
+// corner of each gamer's field on it, in turn order. A layout file holds
+//   field <width> <height>
+//   at <x> <y>        one line per gamer
+//   frame
+// followed by the picture, one line per screen row.
+struct BoardLayout {
+	COORD fieldSize;
+	std::vector<COORD> fieldPositions;
+	std::vector<std::string> frame;
+};
+
+// Throws runtime_error if the file cannot be read or is not a layout
+BoardLayout loadLayout(const std::string& path);
+// Fields with column letters (numbers past 26 columns) and row numbers, in a grid of about
+// as many columns as rows
+BoardLayout gridLayout(COORD fieldSize, int fieldCount);
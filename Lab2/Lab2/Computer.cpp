@@ -0,0 +1,280 @@
+#include "Computer.h"
+#include <stdexcept>
+#include <algorithm>
+#include <mutex>
+
+namespace {
+	// Layouts a reproducible MonteCarloComputer draws per move, 5 to 12 milliseconds of one core on a 10x10 field
+	const long long MONTE_CARLO_SAMPLES = 2000;
+}
+
+Computer::Computer(const std::string& name, COORD fieldSize, uint64_t seed) : fleetPlaced(false), fleetGenerator(fieldSize), fieldSize(fieldSize), field(fieldSize), fleet(fleetForField(fieldSize)), random(seed) {
+	this->name = name;
+}
+
+COORD Computer::cellCoord(int cell) const {
+	COORD coord;
+	coord.X = short(cell % fieldSize.X);
+	coord.Y = short(cell / fieldSize.X);
+	return coord;
+}
+
+int Computer::randomCell(const Bitboard& cells) {
+	return cells.nth(std::uniform_int_distribution<int>(0, cells.count() - 1)(random));
+}
+
+void Computer::act(GameStage stage, ActionQueue& actions) {
+	if (stage == SETUP) {
+		if (!fleetPlaced) {
+			Bitboard ships = fleetGenerator.generate(random);
+			for (int cell = ships.next(0); cell != -1; cell = ships.next(cell + 1)) placement.push_back(cellCoord(cell));
+			fleetPlaced = true;
+		}
+		// The whole fleet at once, as far as the queue holds it
+		for (; !placement.empty() && !actions.full(); placement.pop_back()) actions.push(Action(PLACE_SHIP, placement.back()));
+		if (placement.empty()) actions.push(Action(CONFIRM));
+		return;
+	}
+	actions.push(Action(SHOOT, cellCoord(chooseTarget())));
+}
+
+void Computer::shotResult(COORD cell, ShotOutcome outcome) {
+	int index = cell.Y * fieldSize.X + cell.X;
+	enemyField.shots.set(index);
+	if (outcome != SHOT_MISS) enemyField.ships.set(index);
+}
+
+void Computer::enemyChanged() {
+	enemyField = FieldBoard();
+}
+
+int RandomComputer::chooseTarget() {
+	return randomCell(field.all().andNot(enemyField.shots));
+}
+
+HuntingComputer::HuntingComputer(const std::string& name, COORD fieldSize, uint64_t seed) : Computer(name, fieldSize, seed) {
+	for (int cell = 0; cell < fieldSize.X * fieldSize.Y; ++cell) {
+		if ((cell % fieldSize.X + cell / fieldSize.X) % 2 == 0) checkerboardCells.set(cell);
+	}
+}
+
+int HuntingComputer::chooseTarget() {
+	Bitboard unknown = field.all().andNot(enemyField.shots).andNot(excludedCells);
+	if (unknown.none()) unknown = field.all().andNot(enemyField.shots);
+	Bitboard wounded = enemyField.ships.andNot(sunkCells);
+	if (wounded.any()) {
+		// Finish one ship at a time: the hits next to the first one. Two hits of one ship give
+		// its direction: then only cells along that line qualify.
+		wounded = enemyField.shipAt(wounded.next(0), fieldSize);
+		int first = wounded.next(0);
+		int second = wounded.next(first + 1);
+		bool lineKnown = second != -1;
+		bool horizontal = lineKnown && second / fieldSize.X == first / fieldSize.X;
+		Bitboard candidates;
+		for (int cell = first; cell != -1; cell = wounded.next(cell + 1)) {
+			int x = cell % fieldSize.X;
+			if (!lineKnown || horizontal) {
+				if (x > 0 && unknown.test(cell - 1)) candidates.set(cell - 1);
+				if (x < fieldSize.X - 1 && unknown.test(cell + 1)) candidates.set(cell + 1);
+			}
+			if (!lineKnown || !horizontal) {
+				if (cell >= fieldSize.X && unknown.test(cell - fieldSize.X)) candidates.set(cell - fieldSize.X);
+				if (cell + fieldSize.X < fieldSize.X * fieldSize.Y && unknown.test(cell + fieldSize.X)) candidates.set(cell + fieldSize.X);
+			}
+		}
+		if (candidates.any()) return randomCell(candidates);
+	}
+	Bitboard checkerboard = unknown & checkerboardCells;
+	return randomCell(checkerboard.any() ? checkerboard : unknown);
+}
+
+void HuntingComputer::shotResult(COORD cell, ShotOutcome outcome) {
+	Computer::shotResult(cell, outcome);
+	if (outcome != SHOT_SUNK) return;
+	Bitboard ship = enemyField.shipAt(cell.Y * fieldSize.X + cell.X, fieldSize);
+	sunkCells = sunkCells | ship;
+	excludedCells = excludedCells | field.surroundings(ship);
+}
+
+void HuntingComputer::enemyChanged() {
+	Computer::enemyChanged();
+	sunkCells = excludedCells = Bitboard();
+}
+
+DensityComputer::DensityComputer(const std::string& name, COORD fieldSize, uint64_t seed)
+	: Computer(name, fieldSize, seed), table(fieldSize), alive(table.size(), 1), hitsCovered(table.size(), 0),
+	heat(fieldSize.X * fieldSize.Y, 0), hitHeat(fieldSize.X * fieldSize.Y, 0) {
+	forgetEnemy();
+}
+
+void DensityComputer::forgetEnemy() {
+	for (int length = 0; length <= MAX_SHIP_LENGTH; ++length) shipsAfloat[length] = fleet.counts[length];
+	std::fill(alive.begin(), alive.end(), 1);
+	std::fill(hitsCovered.begin(), hitsCovered.end(), 0);
+	std::fill(heat.begin(), heat.end(), 0);
+	std::fill(hitHeat.begin(), hitHeat.end(), 0);
+	for (int placement = 0; placement < table.size(); ++placement) addWeight(placement, 1);
+}
+
+void DensityComputer::enemyChanged() {
+	Computer::enemyChanged();
+	forgetEnemy();
+}
+
+void DensityComputer::addWeight(int placement, int sign) {
+	const ShipPlacement& ship = table[placement];
+	long long weight = sign * shipsAfloat[ship.length];
+	for (int i = 0; i < ship.length; ++i) {
+		heat[ship.cells[i]] += weight;
+		hitHeat[ship.cells[i]] += weight * hitsCovered[placement];
+	}
+}
+
+void DensityComputer::ruleOut(int cell) {
+	for (const int* placement = table.coveringBegin(cell); placement != table.coveringEnd(cell); ++placement) {
+		if (!alive[*placement]) continue;
+		addWeight(*placement, -1);
+		alive[*placement] = 0;
+	}
+}
+
+void DensityComputer::markWounded(int cell) {
+	for (const int* placement = table.coveringBegin(cell); placement != table.coveringEnd(cell); ++placement) {
+		if (!alive[*placement]) continue;
+		addWeight(*placement, -1);
+		++hitsCovered[*placement];
+		addWeight(*placement, 1);
+	}
+	// Ships are straight and never touch, so the diagonal neighbours of a hit are water
+	int x = cell % fieldSize.X, y = cell / fieldSize.X;
+	for (int dy = -1; dy <= 1; dy += 2) {
+		for (int dx = -1; dx <= 1; dx += 2) {
+			if (x + dx >= 0 && x + dx < fieldSize.X && y + dy >= 0 && y + dy < fieldSize.Y) ruleOut(cell + dy * fieldSize.X + dx);
+		}
+	}
+}
+
+void DensityComputer::sinkShip(const Bitboard& ship) {
+	Bitboard water = field.surroundings(ship);
+	for (int cell = water.next(0); cell != -1; cell = water.next(cell + 1)) ruleOut(cell);
+	int length = ship.count();
+	if (length > MAX_SHIP_LENGTH || shipsAfloat[length] == 0) return;
+	// One ship less of this length lowers the weight of all its remaining placements
+	for (int placement = table.firstOfLength(length); placement < table.firstOfLength(length + 1); ++placement) {
+		if (alive[placement]) addWeight(placement, -1);
+	}
+	--shipsAfloat[length];
+	for (int placement = table.firstOfLength(length); placement < table.firstOfLength(length + 1); ++placement) {
+		if (alive[placement]) addWeight(placement, 1);
+	}
+}
+
+int DensityComputer::chooseTarget() {
+	Bitboard unshot = field.all().andNot(enemyField.shots);
+	bool hunting = true;
+	for (int cell = unshot.next(0); cell != -1 && hunting; cell = unshot.next(cell + 1)) hunting = hitHeat[cell] == 0;
+	const std::vector<long long>& score = hunting ? heat : hitHeat;
+	int best = -1, ties = 0;
+	for (int cell = unshot.next(0); cell != -1; cell = unshot.next(cell + 1)) {
+		if (best != -1 && score[cell] < score[best]) continue;
+		if (best == -1 || score[cell] > score[best]) {
+			best = cell;
+			ties = 1;
+		}
+		else if (random() % ++ties == 0) best = cell;
+	}
+	return score[best] > 0 ? best : randomCell(unshot);
+}
+
+void DensityComputer::shotResult(COORD cell, ShotOutcome outcome) {
+	Computer::shotResult(cell, outcome);
+	int index = cell.Y * fieldSize.X + cell.X;
+	if (outcome == SHOT_MISS) {
+		ruleOut(index);
+		return;
+	}
+	markWounded(index);
+	if (outcome == SHOT_SUNK) sinkShip(enemyField.shipAt(index, fieldSize));
+}
+
+MonteCarloComputer::MonteCarloComputer(const std::string& name, COORD fieldSize, uint64_t seed, std::chrono::microseconds moveTime, unsigned threadCount)
+	: Computer(name, fieldSize, seed), table(fieldSize), moveTime(moveTime), threadCount(std::max(threadCount, 1u)), samplesPerMove(0) {
+	for (int length = 0; length <= MAX_SHIP_LENGTH; ++length) shipsAfloat[length] = fleet.counts[length];
+}
+
+MonteCarloComputer::MonteCarloComputer(const std::string& name, COORD fieldSize, uint64_t seed, long long samplesPerMove)
+	: Computer(name, fieldSize, seed), table(fieldSize), moveTime(0), threadCount(1), samplesPerMove(std::max(samplesPerMove, 1ll)) {
+	for (int length = 0; length <= MAX_SHIP_LENGTH; ++length) shipsAfloat[length] = fleet.counts[length];
+}
+
+void MonteCarloComputer::enemyChanged() {
+	Computer::enemyChanged();
+	sunkCells = waterCells = Bitboard();
+	for (int length = 0; length <= MAX_SHIP_LENGTH; ++length) shipsAfloat[length] = fleet.counts[length];
+}
+
+int MonteCarloComputer::chooseTarget() {
+	Bitboard unshot = field.all().andNot(enemyField.shots);
+	Bitboard forbidden = enemyField.shots.andNot(enemyField.ships) | waterCells | sunkCells;
+	LayoutSampler sampler(table, fieldSize, forbidden, enemyField.ships.andNot(sunkCells), shipsAfloat);
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + moveTime;
+	std::vector<long long> hitCounts(fieldSize.X * fieldSize.Y, 0);
+	std::mutex countsGuard;
+	std::vector<uint64_t> seeds;
+	for (unsigned i = 0; i < threadCount; ++i) seeds.push_back(random());
+	auto sampleUntilDeadline = [&](uint64_t seed) {
+		std::mt19937_64 threadRandom(seed);
+		std::vector<long long> counts(hitCounts.size(), 0);
+		// Every step of the chain is one more layout, far cheaper than an independent one
+		LayoutChain chain(sampler);
+		long long attempts = 0;
+		do {
+			if (!chain.step(threadRandom)) continue;
+			Bitboard layout = chain.layout() & unshot;
+			for (int cell = layout.next(0); cell != -1; cell = layout.next(cell + 1)) ++counts[cell];
+		} while (samplesPerMove > 0 ? ++attempts < samplesPerMove : std::chrono::steady_clock::now() < deadline);
+		std::lock_guard<std::mutex> lock(countsGuard);
+		for (size_t cell = 0; cell < counts.size(); ++cell) hitCounts[cell] += counts[cell];
+	};
+	std::vector<std::thread> helpers;
+	for (unsigned i = 1; i < threadCount; ++i) helpers.emplace_back(sampleUntilDeadline, seeds[i]);
+	sampleUntilDeadline(seeds[0]);
+	for (std::thread& helper : helpers) helper.join();
+	int best = -1;
+	for (int cell = unshot.next(0); cell != -1; cell = unshot.next(cell + 1)) {
+		if (best == -1 || hitCounts[cell] > hitCounts[best]) best = cell;
+	}
+	// No consistent layout was found: the enemy fleet is not the one of fleetForField
+	return hitCounts[best] > 0 ? best : randomCell(unshot);
+}
+
+void MonteCarloComputer::shotResult(COORD cell, ShotOutcome outcome) {
+	Computer::shotResult(cell, outcome);
+	int index = cell.Y * fieldSize.X + cell.X;
+	if (outcome == SHOT_MISS) return;
+	// Ships are straight and never touch, so the diagonal neighbours of a hit are water
+	int x = cell.X, y = cell.Y;
+	for (int dy = -1; dy <= 1; dy += 2) {
+		for (int dx = -1; dx <= 1; dx += 2) {
+			if (x + dx >= 0 && x + dx < fieldSize.X && y + dy >= 0 && y + dy < fieldSize.Y) waterCells.set(index + dy * fieldSize.X + dx);
+		}
+	}
+	if (outcome != SHOT_SUNK) return;
+	Bitboard ship = enemyField.shipAt(index, fieldSize);
+	sunkCells = sunkCells | ship;
+	waterCells = waterCells | field.surroundings(ship).andNot(ship);
+	int length = ship.count();
+	if (length <= MAX_SHIP_LENGTH && shipsAfloat[length] > 0) --shipsAfloat[length];
+}
+
+std::unique_ptr<Computer> createComputer(const std::string& strategy, const std::string& name, COORD fieldSize, uint64_t seed,
+	bool reproducible) {
+	if (strategy == "random") return std::unique_ptr<Computer>(new RandomComputer(name, fieldSize, seed));
+	if (strategy == "hunt") return std::unique_ptr<Computer>(new HuntingComputer(name, fieldSize, seed));
+	if (strategy == "montecarlo") {
+		if (reproducible) return std::unique_ptr<Computer>(new MonteCarloComputer(name, fieldSize, seed, MONTE_CARLO_SAMPLES));
+		return std::unique_ptr<Computer>(new MonteCarloComputer(name, fieldSize, seed));
+	}
+	if (strategy == "density") return std::unique_ptr<Computer>(new DensityComputer(name, fieldSize, seed));
+	throw std::invalid_argument("unknown computer strategy: " + strategy);
+}
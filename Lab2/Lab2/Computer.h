@@ -0,0 +1,112 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <memory>
+#include <random>
+#include <cstdint>
+#include <chrono>
+#include <thread>
+#include "Game.h"
+#include "Fleet.h"
+
+// Gamer driven by a strategy instead of the keyboard. During setup it places a random fleet of
+// the field size one cell per action and confirms; during battle it shoots the cell chooseTarget returns.
+class Computer : public Gamer {
+	std::vector<COORD> placement;
+	bool fleetPlaced;
+	FleetGenerator fleetGenerator;
+protected:
+	COORD fieldSize;
+	FieldMasks field;
+	Fleet fleet;
+	std::mt19937_64 random;
+	// The enemy field as this gamer has seen it: its own shots and the hits among them
+	FieldBoard enemyField;
+	COORD cellCoord(int cell) const;
+	// Uniformly chosen cell of a non-empty set
+	int randomCell(const Bitboard& cells);
+	virtual int chooseTarget() = 0;
+public:
+	Computer(const std::string& name, COORD fieldSize, uint64_t seed);
+	virtual void act(GameStage stage, ActionQueue& actions);
+	virtual void shotResult(COORD cell, ShotOutcome outcome);
+	virtual void enemyChanged();
+};
+
+// Shoots uniformly at cells it has not shot yet
+class RandomComputer : public Computer {
+protected:
+	virtual int chooseTarget();
+public:
+	RandomComputer(const std::string& name, COORD fieldSize, uint64_t seed) : Computer(name, fieldSize, seed) {}
+};
+
+// Hunts on a checkerboard until a hit, then finishes the wounded ship along its line.
+// Cells around sunk ships are skipped because ships never touch.
+class HuntingComputer : public Computer {
+	Bitboard checkerboardCells;
+	Bitboard sunkCells;
+	Bitboard excludedCells;
+protected:
+	virtual int chooseTarget();
+public:
+	HuntingComputer(const std::string& name, COORD fieldSize, uint64_t seed);
+	virtual void shotResult(COORD cell, ShotOutcome outcome);
+	virtual void enemyChanged();
+};
+
+// Shoots the cell covered by the most placements of the ships still afloat that agree with
+// everything seen so far. While a ship is wounded only placements through its hits count.
+// Each placement is either alive or ruled out, and a shot result only revisits the placements
+// covering the cells it affects, so the per-cell counts are updated instead of recomputed.
+class DensityComputer : public Computer {
+	PlacementTable table;
+	std::vector<char> alive;
+	// Wounded (hit but not sunk) cells each placement covers
+	std::vector<int> hitsCovered;
+	// Per cell: alive placements covering it, each weighted by the number of ships of its length afloat
+	std::vector<long long> heat;
+	// The same, each placement counted once per wounded cell it covers
+	std::vector<long long> hitHeat;
+	int shipsAfloat[MAX_SHIP_LENGTH + 1];
+	void addWeight(int placement, int sign);
+	void ruleOut(int cell);
+	void markWounded(int cell);
+	void sinkShip(const Bitboard& ship);
+	void forgetEnemy();
+protected:
+	virtual int chooseTarget();
+public:
+	DensityComputer(const std::string& name, COORD fieldSize, uint64_t seed);
+	virtual void shotResult(COORD cell, ShotOutcome outcome);
+	virtual void enemyChanged();
+};
+
+// Samples whole enemy fleet layouts that agree with the enemy field seen so far, a LayoutChain
+// per thread, and shoots the unshot cell most often covered by a ship. Sampling runs on several
+// threads until the time budget of the move is spent, so the estimate gets better with more cores. With a sample budget
+// instead it draws a fixed number of layouts on the calling thread, so its moves depend only on the seed.
+class MonteCarloComputer : public Computer {
+	PlacementTable table;
+	Bitboard sunkCells;
+	Bitboard waterCells;
+	int shipsAfloat[MAX_SHIP_LENGTH + 1];
+	std::chrono::microseconds moveTime;
+	unsigned threadCount;
+	// Sampling attempts per move, 0 when the move is limited by moveTime
+	long long samplesPerMove;
+protected:
+	virtual int chooseTarget();
+public:
+	MonteCarloComputer(const std::string& name, COORD fieldSize, uint64_t seed,
+		std::chrono::microseconds moveTime = std::chrono::microseconds(5000), unsigned threadCount = std::thread::hardware_concurrency());
+	MonteCarloComputer(const std::string& name, COORD fieldSize, uint64_t seed, long long samplesPerMove);
+	virtual void shotResult(COORD cell, ShotOutcome outcome);
+	virtual void enemyChanged();
+};
+
+// Strategies: "random", "hunt", "density", "montecarlo". Throws invalid_argument for an unknown one.
+// A reproducible computer plays the same game for the same seed and opponents and uses only the
+// calling thread; it is meant for callers that run many games in parallel.
+std::unique_ptr<Computer> createComputer(const std::string& strategy, const std::string& name, COORD fieldSize, uint64_t seed,
+	bool reproducible = false);
@@ -0,0 +1,381 @@
+#include "Fleet.h"
+#include <algorithm>
+
+namespace {
+	const int GENERATION_ATTEMPTS = 1000;
+	// Gibbs sweeps after the sequential placement
+	const int MIXING_SWEEPS = 8;
+	// A one-cell placement and two of every longer length per cell of the ship
+	const int MAX_PLACEMENTS_THROUGH_CELL = 1 + 2 * (2 + 3 + 4);
+
+	// A uniform index below count from 32 random bits by multiplication, or -1 for the few bit
+	// patterns that would make some indices more likely than others
+	inline int boundedIndex(uint32_t bits, uint32_t count) {
+		uint64_t product = uint64_t(bits) * count;
+		if (uint32_t(product) < count && uint32_t(product) < (0u - count) % count) return -1;
+		return int(product >> 32);
+	}
+}
+
+Fleet fleetForField(COORD fieldSize) {
+	int copies = std::max(fieldSize.X * fieldSize.Y / 100, 1);
+	Fleet fleet;
+	for (int length = 0; length <= MAX_SHIP_LENGTH; ++length) fleet.counts[length] = STANDARD_FLEET[length] * copies;
+	return fleet;
+}
+
+FieldMasks::FieldMasks(COORD fieldSize) : fieldSize(fieldSize) {
+	if (fieldSize.X * fieldSize.Y > MAX_FIELD_CELLS) throw std::invalid_argument("field is too large");
+	for (int cell = 0; cell < fieldSize.X * fieldSize.Y; ++cell) {
+		cells.set(cell);
+		if (cell % fieldSize.X != 0) notFirstColumn.set(cell);
+		if (cell % fieldSize.X != fieldSize.X - 1) notLastColumn.set(cell);
+	}
+}
+
+Bitboard FieldMasks::surroundings(const Bitboard& cells) const {
+	Bitboard row = cells | (cells.shiftedUp(1) & notFirstColumn) | (cells.shiftedDown(1) & notLastColumn);
+	return (row | row.shiftedUp(fieldSize.X) | row.shiftedDown(fieldSize.X)) & this->cells;
+}
+
+bool isValidFleet(const Bitboard& ships, const FieldMasks& field, const int* fleet) {
+	if (ships.andNot(field.all()).any()) return false;
+	// No corner contacts. A bent or branched ship would need one too, so every group of
+	// side-connected cells is a straight ship, and ships touching by side would merge into one.
+	Bitboard shiftedRight = field.movedRight(ships);
+	if ((field.movedDown(shiftedRight) & ships).any() || (field.movedDown(field.movedLeft(ships)) & ships).any()) return false;
+	Bitboard shiftedLeft = field.movedLeft(ships);
+	Bitboard shiftedDown = field.movedDown(ships);
+	Bitboard shiftedUp = field.movedUp(ships);
+	int shipCount[MAX_SHIP_LENGTH + 2] = {};
+	shipCount[1] = ships.andNot(shiftedRight | shiftedLeft | shiftedDown | shiftedUp).count();
+	// Walk from the first cell of every horizontal and vertical ship: after k steps
+	// the walkers still on ship cells are the ships longer than k
+	Bitboard horizontal = (ships & shiftedLeft).andNot(shiftedRight);
+	Bitboard vertical = (ships & shiftedUp).andNot(shiftedDown);
+	for (int length = 2; length <= MAX_SHIP_LENGTH + 1; ++length) {
+		horizontal = field.movedRight(horizontal) & ships;
+		vertical = field.movedDown(vertical) & ships;
+		shipCount[length] = horizontal.count() + vertical.count();
+	}
+	if (shipCount[MAX_SHIP_LENGTH + 1] != 0) return false;
+	for (int length = 1; length <= MAX_SHIP_LENGTH; ++length) {
+		int exactly = length == 1 ? shipCount[1] : shipCount[length] - shipCount[length + 1];
+		if (exactly != fleet[length]) return false;
+	}
+	return true;
+}
+
+PlacementTable::PlacementTable(COORD fieldSize) {
+	int cellCount = fieldSize.X * fieldSize.Y;
+	lengthOffsets.push_back(0);
+	lengthOffsets.push_back(0);
+	for (int length = 1; length <= MAX_SHIP_LENGTH; ++length) {
+		// A one-cell ship has a single orientation
+		for (int vertical = 0; vertical < (length == 1 ? 1 : 2); ++vertical) {
+			int width = vertical ? 1 : length, height = vertical ? length : 1;
+			for (int y = 0; y + height <= fieldSize.Y; ++y) {
+				for (int x = 0; x + width <= fieldSize.X; ++x) {
+					ShipPlacement placement;
+					placement.length = length;
+					for (int i = 0; i < length; ++i) placement.cells[i] = (y + (vertical ? i : 0)) * fieldSize.X + x + (vertical ? 0 : i);
+					placements.push_back(placement);
+				}
+			}
+		}
+		lengthOffsets.push_back(int(placements.size()));
+	}
+	coverOffsets.assign(cellCount + 1, 0);
+	for (const ShipPlacement& placement : placements) {
+		for (int i = 0; i < placement.length; ++i) ++coverOffsets[placement.cells[i] + 1];
+	}
+	for (int cell = 0; cell < cellCount; ++cell) coverOffsets[cell + 1] += coverOffsets[cell];
+	covering.resize(coverOffsets[cellCount]);
+	std::vector<int> filled(coverOffsets.begin(), coverOffsets.end() - 1);
+	for (int index = 0; index < size(); ++index) {
+		for (int i = 0; i < placements[index].length; ++i) covering[filled[placements[index].cells[i]]++] = index;
+	}
+}
+
+LayoutSampler::LayoutSampler(const PlacementTable& table, COORD fieldSize, const Bitboard& forbidden, const Bitboard& wounded, const int* shipsAfloat)
+	: table(table), fieldSize(fieldSize), field(fieldSize), forbidden(forbidden), open(field.all().andNot(forbidden)), wounded(wounded) {
+	int shipCount = 0;
+	for (int length = 0; length <= MAX_SHIP_LENGTH; ++length) {
+		this->shipsAfloat[length] = shipsAfloat[length];
+		shipCount += shipsAfloat[length];
+	}
+	if (shipCount > MAX_FLEET_SIZE) throw std::invalid_argument("the fleet is too large");
+	for (int cell = 0; cell < fieldSize.X * fieldSize.Y; ++cell) {
+		for (int length = 1; length <= MAX_SHIP_LENGTH; ++length) {
+			if (cell % fieldSize.X + length <= fieldSize.X) fitsInRow[length].set(cell);
+		}
+	}
+}
+
+// Cells where a ship of the given length and direction can start covering free cells only
+Bitboard LayoutSampler::anchors(const Bitboard& free, int length, bool vertical) const {
+	Bitboard result = vertical ? free : free & fitsInRow[length];
+	for (int i = 1; i < length; ++i) result &= free.shiftedDown(vertical ? i * fieldSize.X : i);
+	return result;
+}
+
+bool LayoutSampler::fits(const ShipPlacement& ship, const Bitboard& blocked) const {
+	for (int i = 0; i < ship.length; ++i) {
+		if (blocked.test(ship.cells[i]) || forbidden.test(ship.cells[i])) return false;
+	}
+	return true;
+}
+
+// A ship next to a hit it does not cover would touch the ship that does
+bool LayoutSampler::touchesOtherHits(const ShipPlacement& ship) const {
+	Bitboard around = field.surroundings(ship.mask()) & wounded;
+	for (int i = 0; i < ship.length; ++i) around.reset(ship.cells[i]);
+	return around.any();
+}
+
+// The surroundings of a straight ship are a rectangle
+void LayoutSampler::surroundingRectangle(const ShipPlacement& ship, int& left, int& top, int& right, int& bottom) const {
+	int first = ship.cells[0], last = ship.cells[ship.length - 1];
+	left = first % fieldSize.X;
+	top = first / fieldSize.X;
+	right = last % fieldSize.X;
+	bottom = last / fieldSize.X;
+	if (left > 0) --left;
+	if (top > 0) --top;
+	if (right < fieldSize.X - 1) ++right;
+	if (bottom < fieldSize.Y - 1) ++bottom;
+}
+
+void LayoutSampler::place(const ShipPlacement& ship, Bitboard& layout, Bitboard& blocked) const {
+	int left, top, right, bottom;
+	surroundingRectangle(ship, left, top, right, bottom);
+	for (int y = top; y <= bottom; ++y) blocked.setRange(y * fieldSize.X + left, right - left + 1);
+	for (int i = 0; i < ship.length; ++i) layout.set(ship.cells[i]);
+}
+
+// Counts for each cell the ships whose surroundings cover it
+void LayoutSampler::addSurroundings(const ShipPlacement& ship, unsigned char* blockers, int change) const {
+	int left, top, right, bottom;
+	surroundingRectangle(ship, left, top, right, bottom);
+	for (int y = top; y <= bottom; ++y) {
+		for (int x = left; x <= right; ++x) blockers[y * fieldSize.X + x] += change;
+	}
+}
+
+bool LayoutSampler::coversHits(const ShipPlacement& ship) const {
+	for (int i = 0; i < ship.length; ++i) {
+		if (wounded.test(ship.cells[i])) return true;
+	}
+	return false;
+}
+
+bool LayoutSampler::clear(const ShipPlacement& ship, const unsigned char* blockers) const {
+	for (int i = 0; i < ship.length; ++i) {
+		if (blockers[ship.cells[i]] != 0) return false;
+	}
+	return true;
+}
+
+// Placements of the length on free cells: horizontal ones by start cell first, then vertical ones
+int LayoutSampler::freePlacements(const Bitboard& free, int length, Bitboard& horizontal, Bitboard& vertical) const {
+	horizontal = anchors(free, length, false);
+	vertical = length > 1 ? anchors(free, length, true) : Bitboard();
+	return horizontal.count() + vertical.count();
+}
+
+ShipPlacement LayoutSampler::freePlacement(const Bitboard& horizontal, const Bitboard& vertical, int length, int index) const {
+	int horizontalCount = horizontal.count();
+	bool isVertical = index >= horizontalCount;
+	ShipPlacement ship;
+	ship.length = length;
+	ship.cells[0] = isVertical ? vertical.nth(index - horizontalCount) : horizontal.nth(index);
+	for (int i = 1; i < length; ++i) ship.cells[i] = ship.cells[i - 1] + (isVertical ? fieldSize.X : 1);
+	return ship;
+}
+
+// Ship a, or ships a and b together when b >= 0, drawn again uniformly from the placements of
+// their lengths that fit next to the other ships and cover the hits the other ships leave. With
+// such hits, one of the ships covers the first of them and the other one covers the rest, if any.
+void LayoutSampler::redraw(std::mt19937_64& random, ShipPlacement* ships, int a, int b, const unsigned char* blockers) const {
+	Bitboard hits;
+	for (int ship = a; ship != -1; ship = ship == a ? b : -1) {
+		for (int i = 0; i < ships[ship].length; ++i) {
+			if (wounded.test(ships[ship].cells[i])) hits.set(ships[ship].cells[i]);
+		}
+	}
+	if (hits.none()) {
+		// The pairs without hits are too many to count, so a pair without hits stays in place
+		if (b >= 0) return;
+		// Any placement of the length until one fits, two tries per random word; the place the
+		// ship leaves always fits
+		int first = table.firstOfLength(ships[a].length);
+		uint32_t count = uint32_t(table.firstOfLength(ships[a].length + 1) - first);
+		for (;;) {
+			uint64_t bits = random();
+			for (int half = 0; half < 2; ++half, bits >>= 32) {
+				int index = boundedIndex(uint32_t(bits), count);
+				if (index >= 0 && clear(table[first + index], blockers)) {
+					ships[a] = table[first + index];
+					return;
+				}
+			}
+		}
+	}
+	Bitboard free;
+	if (b >= 0) {
+		for (int cell = 0; cell < fieldSize.X * fieldSize.Y; ++cell) {
+			if (blockers[cell] == 0) free.set(cell);
+		}
+	}
+	// Every placement through the first hit with the ship taking it and the ways to complete it
+	struct Option {
+		const ShipPlacement* first;
+		int taker;
+		int completions;
+	} options[2 * MAX_PLACEMENTS_THROUGH_CELL];
+	int optionCount = 0, total = 0, hit = hits.next(0);
+	for (const int* through = table.coveringBegin(hit); through != table.coveringEnd(hit); ++through) {
+		const ShipPlacement& first = table[*through];
+		if (!clear(first, blockers)) continue;
+		for (int taker = a; taker != -1; taker = taker == a ? b : -1) {
+			if (first.length != ships[taker].length) continue;
+			int other = taker == a ? b : a;
+			int completions = completeThroughHits(first, hits, other == -1 ? 0 : ships[other].length, free, -1, nullptr);
+			if (completions == 0) continue;
+			Option option = { &first, taker, completions };
+			options[optionCount++] = option;
+			total += completions;
+		}
+	}
+	int index = std::uniform_int_distribution<int>(0, total - 1)(random);
+	const Option* chosen = options;
+	for (; index >= chosen->completions; ++chosen) index -= chosen->completions;
+	int other = chosen->taker == a ? b : a;
+	ships[chosen->taker] = *chosen->first;
+	if (other != -1) completeThroughHits(*chosen->first, hits, ships[other].length, free, index, &ships[other]);
+}
+
+// The ways a ship of otherLength (0 for none) completes the first ship of a redraw: anywhere on
+// free cells off the surroundings of the first ship when it covers all the hits, otherwise
+// through the hits it leaves. Stores the way with the given index unless the index is -1.
+int LayoutSampler::completeThroughHits(const ShipPlacement& first, const Bitboard& hits, int otherLength, const Bitboard& free, int index, ShipPlacement* other) const {
+	Bitboard rest = hits.andNot(first.mask());
+	if (otherLength == 0) return rest.none() ? 1 : 0;
+	Bitboard otherFree = free.andNot(field.surroundings(first.mask()));
+	if (rest.none()) {
+		Bitboard horizontal, vertical;
+		int count = freePlacements(otherFree, otherLength, horizontal, vertical);
+		if (index >= 0) *other = freePlacement(horizontal, vertical, otherLength, index);
+		return count;
+	}
+	int count = 0, restHit = rest.next(0);
+	for (const int* second = table.coveringBegin(restHit); second != table.coveringEnd(restHit); ++second) {
+		const ShipPlacement& candidate = table[*second];
+		if (candidate.length != otherLength || rest.andNot(candidate.mask()).any() || candidate.mask().andNot(otherFree).any()) continue;
+		if (count++ == index) *other = candidate;
+	}
+	return count;
+}
+
+// The ships through the hits first, then the others longest first, each uniformly from the
+// placements that fit next to the ships already placed
+bool LayoutSampler::placeSequentially(std::mt19937_64& random, ShipPlacement* ships, int& shipCount) const {
+	Bitboard layout, blocked;
+	shipCount = 0;
+	int afloat[MAX_SHIP_LENGTH + 1];
+	for (int length = 0; length <= MAX_SHIP_LENGTH; ++length) afloat[length] = shipsAfloat[length];
+	// Ships through the hits: the first uncovered hit picks among the placements covering it
+	for (int hit = wounded.next(0); hit != -1; hit = wounded.andNot(layout).next(hit + 1)) {
+		int count = 0, chosen = -1;
+		for (int pass = 0; pass < 2; ++pass) {
+			int index = pass == 0 ? 0 : std::uniform_int_distribution<int>(0, count - 1)(random);
+			for (const int* placement = table.coveringBegin(hit); placement != table.coveringEnd(hit) && chosen == -1; ++placement) {
+				const ShipPlacement& ship = table[*placement];
+				if (afloat[ship.length] == 0 || !fits(ship, blocked) || touchesOtherHits(ship)) continue;
+				if (pass == 0) ++count;
+				else if (index-- == 0) chosen = *placement;
+			}
+			if (count == 0) return false;
+		}
+		place(table[chosen], layout, blocked);
+		ships[shipCount++] = table[chosen];
+		--afloat[table[chosen].length];
+	}
+	// The other ships: every start cell and direction that fits is found at once with bit operations
+	for (int length = MAX_SHIP_LENGTH; length >= 1; --length) {
+		for (; afloat[length] > 0; --afloat[length]) {
+			Bitboard horizontal, vertical;
+			int count = freePlacements(open.andNot(blocked), length, horizontal, vertical);
+			if (count == 0) return false;
+			ShipPlacement ship = freePlacement(horizontal, vertical, length, std::uniform_int_distribution<int>(0, count - 1)(random));
+			place(ship, layout, blocked);
+			ships[shipCount++] = ship;
+		}
+	}
+	return true;
+}
+
+// Gibbs moves: every ship in turn is drawn again uniformly from the places it fits next to the
+// others. With hits on the field it is then drawn together with another random ship, so that a
+// hit can pass to a ship of another length. Each move leaves the uniform distribution over
+// consistent layouts unchanged and the sweeps carry the layout towards it.
+void LayoutSampler::sweep(std::mt19937_64& random, ShipPlacement* ships, int shipCount, unsigned char* blockers) const {
+	for (int i = 0; i < shipCount; ++i) {
+		addSurroundings(ships[i], blockers, -1);
+		redraw(random, ships, i, -1, blockers);
+		if (wounded.any() && shipCount > 1) {
+			int partner = std::uniform_int_distribution<int>(0, shipCount - 2)(random);
+			if (partner >= i) ++partner;
+			// A pair without hits stays in place anyway
+			if (coversHits(ships[i]) || coversHits(ships[partner])) {
+				addSurroundings(ships[partner], blockers, -1);
+				redraw(random, ships, i, partner, blockers);
+				addSurroundings(ships[partner], blockers, 1);
+			}
+		}
+		addSurroundings(ships[i], blockers, 1);
+	}
+}
+
+bool LayoutSampler::sample(std::mt19937_64& random, Bitboard& layout) const {
+	LayoutChain chain(*this);
+	if (!chain.restart(random)) return false;
+	layout = chain.layout();
+	return true;
+}
+
+bool LayoutChain::restart(std::mt19937_64& random) {
+	started = sampler.placeSequentially(random, ships, shipCount);
+	if (!started) return false;
+	// Forbidden cells count as blocked once and for all
+	for (int cell = 0; cell < sampler.fieldSize.X * sampler.fieldSize.Y; ++cell) blockers[cell] = sampler.forbidden.test(cell) ? 1 : 0;
+	for (int i = 0; i < shipCount; ++i) sampler.addSurroundings(ships[i], blockers, 1);
+	for (int sweep = 0; sweep < MIXING_SWEEPS; ++sweep) sampler.sweep(random, ships, shipCount, blockers);
+	return true;
+}
+
+bool LayoutChain::step(std::mt19937_64& random) {
+	if (!started) return restart(random);
+	sampler.sweep(random, ships, shipCount, blockers);
+	return true;
+}
+
+Bitboard LayoutChain::layout() const {
+	Bitboard result;
+	for (int i = 0; i < shipCount; ++i) {
+		for (int cell = 0; cell < ships[i].length; ++cell) result.set(ships[i].cells[cell]);
+	}
+	return result;
+}
+
+FleetGenerator::FleetGenerator(COORD fieldSize) : FleetGenerator(fieldSize, fleetForField(fieldSize)) {}
+
+FleetGenerator::FleetGenerator(COORD fieldSize, const Fleet& fleet) : table(fieldSize), sampler(table, fieldSize, Bitboard(), Bitboard(), fleet.counts) {}
+
+Bitboard FleetGenerator::generate(std::mt19937_64& random) const {
+	Bitboard ships;
+	for (int attempt = 0; attempt < GENERATION_ATTEMPTS; ++attempt) {
+		if (sampler.sample(random, ships)) return ships;
+	}
+	throw std::invalid_argument("the fleet does not fit the field");
+}
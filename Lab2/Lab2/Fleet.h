@@ -0,0 +1,165 @@
+#pragma once
+#include <vector>
+#include <random>
+#include <stdexcept>
+#include "Terminal.h"
+#include "Bitboard.h"
+
+const int MAX_SHIP_LENGTH = 4;
+// Standard fleet, ship count by length: four 1-cell ships, three 2-cell, two 3-cell and one 4-cell
+const int STANDARD_FLEET[MAX_SHIP_LENGTH + 1] = { 0, 4, 3, 2, 1 };
+
+// Ship count by length
+struct Fleet {
+	int counts[MAX_SHIP_LENGTH + 1];
+};
+
+// The fleet of a field: the standard fleet once per 100 cells and at least once, so larger
+// fields keep the density of the classic 10x10 game
+Fleet fleetForField(COORD fieldSize);
+
+struct ShipPlacement {
+	int length;
+	int cells[MAX_SHIP_LENGTH];
+	Bitboard mask() const {
+		Bitboard result;
+		for (int i = 0; i < length; ++i) result.set(cells[i]);
+		return result;
+	}
+};
+
+// Masks of one field size, so that neighbourhoods are computed with a few shifts.
+// Throws invalid_argument if the field does not fit a Bitboard.
+class FieldMasks {
+	COORD fieldSize;
+	Bitboard cells;
+	Bitboard notFirstColumn;
+	Bitboard notLastColumn;
+public:
+	explicit FieldMasks(COORD fieldSize);
+	const Bitboard& all() const {
+		return cells;
+	}
+	// Every cell moved one step in a direction; cells leaving the field are dropped
+	Bitboard movedLeft(const Bitboard& cells) const {
+		return cells.shiftedDown(1) & notLastColumn;
+	}
+	Bitboard movedRight(const Bitboard& cells) const {
+		return cells.shiftedUp(1) & notFirstColumn;
+	}
+	Bitboard movedUp(const Bitboard& cells) const {
+		return cells.shiftedDown(fieldSize.X);
+	}
+	Bitboard movedDown(const Bitboard& cells) const {
+		return cells.shiftedUp(fieldSize.X) & this->cells;
+	}
+	// The cells plus every cell touching them by side or corner
+	Bitboard surroundings(const Bitboard& cells) const;
+};
+
+// True if the ship cells form exactly the given fleet (ship count by length) of straight ships
+// that touch neither by side nor by corner
+bool isValidFleet(const Bitboard& ships, const FieldMasks& field, const int* fleet = STANDARD_FLEET);
+
+// Every position of every ship length on a field, and for each cell the placements covering it.
+// Placements are grouped by length; the covering lists are stored contiguously.
+class PlacementTable {
+	std::vector<ShipPlacement> placements;
+	std::vector<int> lengthOffsets;
+	std::vector<int> coverOffsets;
+	std::vector<int> covering;
+public:
+	explicit PlacementTable(COORD fieldSize);
+	int size() const {
+		return int(placements.size());
+	}
+	const ShipPlacement& operator[](int index) const {
+		return placements[index];
+	}
+	// Placements of one length occupy indices [firstOfLength(length), firstOfLength(length + 1))
+	int firstOfLength(int length) const {
+		return lengthOffsets[length];
+	}
+	const int* coveringBegin(int cell) const {
+		return covering.data() + coverOffsets[cell];
+	}
+	const int* coveringEnd(int cell) const {
+		return covering.data() + coverOffsets[cell + 1];
+	}
+};
+
+// Ships a LayoutSampler can place: a layout of non-touching ships has at most one per 2x2 block
+const int MAX_FLEET_SIZE = MAX_FIELD_CELLS / 4;
+
+// Draws random fleet layouts consistent with what is known about a field: cells that cannot
+// hold a ship, hit cells of ships not sunk yet, and the ships still afloat. Ships through the
+// hits are placed first, then the others longest first, each drawn uniformly from the
+// placements that fit next to the ships already placed; only a dead end, where some ship has no
+// place left, fails the layout. That alone favours layouts leaving many places to the later
+// ships, so Gibbs sweeps follow (see LayoutChain) and bring the layouts to the uniform
+// distribution over all consistent layouts, which the occupancy self-tests check against exact
+// enumeration. On a 10x10 field with the standard fleet a layout takes about 17 microseconds,
+// 60 with a hit ship afloat. Throws invalid_argument for more than MAX_FLEET_SIZE ships.
+class LayoutSampler {
+	friend class LayoutChain;
+	const PlacementTable& table;
+	COORD fieldSize;
+	FieldMasks field;
+	Bitboard forbidden;
+	Bitboard open;
+	Bitboard wounded;
+	Bitboard fitsInRow[MAX_SHIP_LENGTH + 1];
+	int shipsAfloat[MAX_SHIP_LENGTH + 1];
+	Bitboard anchors(const Bitboard& free, int length, bool vertical) const;
+	bool fits(const ShipPlacement& ship, const Bitboard& blocked) const;
+	bool touchesOtherHits(const ShipPlacement& ship) const;
+	void surroundingRectangle(const ShipPlacement& ship, int& left, int& top, int& right, int& bottom) const;
+	void place(const ShipPlacement& ship, Bitboard& layout, Bitboard& blocked) const;
+	void addSurroundings(const ShipPlacement& ship, unsigned char* blockers, int change) const;
+	bool coversHits(const ShipPlacement& ship) const;
+	bool clear(const ShipPlacement& ship, const unsigned char* blockers) const;
+	int freePlacements(const Bitboard& free, int length, Bitboard& horizontal, Bitboard& vertical) const;
+	ShipPlacement freePlacement(const Bitboard& horizontal, const Bitboard& vertical, int length, int index) const;
+	void redraw(std::mt19937_64& random, ShipPlacement* ships, int a, int b, const unsigned char* blockers) const;
+	int completeThroughHits(const ShipPlacement& first, const Bitboard& hits, int otherLength, const Bitboard& free, int index, ShipPlacement* other) const;
+	bool placeSequentially(std::mt19937_64& random, ShipPlacement* ships, int& shipCount) const;
+	void sweep(std::mt19937_64& random, ShipPlacement* ships, int shipCount, unsigned char* blockers) const;
+public:
+	LayoutSampler(const PlacementTable& table, COORD fieldSize, const Bitboard& forbidden, const Bitboard& wounded, const int* shipsAfloat);
+	// An independent layout; returns false on a dead end, the layout is then incomplete
+	bool sample(std::mt19937_64& random, Bitboard& layout) const;
+};
+
+// Consecutive layouts of a LayoutSampler: a layout like LayoutSampler::sample draws, then one Gibbs
+// sweep per step. The layouts are correlated but each costs a single sweep, 2.5 microseconds on
+// a 10x10 field and 6 with a hit ship afloat, so estimates over many layouts are far cheaper
+// from a chain. One chain per thread; the sampler must outlive it.
+class LayoutChain {
+	const LayoutSampler& sampler;
+	bool started;
+	int shipCount;
+	ShipPlacement ships[MAX_FLEET_SIZE];
+	// For each cell the ships whose surroundings cover it, plus one for a forbidden cell
+	unsigned char blockers[MAX_FIELD_CELLS];
+public:
+	explicit LayoutChain(const LayoutSampler& sampler) : sampler(sampler), started(false), shipCount(0) {}
+	// Starts over from a new layout; returns false on a dead end
+	bool restart(std::mt19937_64& random);
+	// The next layout, starting the chain first if needed; returns false on a dead end
+	bool step(std::mt19937_64& random);
+	Bitboard layout() const;
+};
+
+// Random fleets for an empty field, fleetForField unless given: a LayoutSampler with nothing
+// known, retried on dead ends. Throws invalid_argument if the fleet does not fit the field.
+class FleetGenerator {
+	PlacementTable table;
+	LayoutSampler sampler;
+public:
+	explicit FleetGenerator(COORD fieldSize);
+	FleetGenerator(COORD fieldSize, const Fleet& fleet);
+	FleetGenerator(const FleetGenerator&) = delete;
+	FleetGenerator& operator=(const FleetGenerator&) = delete;
+	Bitboard generate(std::mt19937_64& random) const;
+};
+
@@ -0,0 +1,78 @@
+#include "FrameProfiler.h"
+#include <algorithm>
+
+Histogram::Histogram() : counts(), total(0), sum(0), maximum(0) {}
+
+void Histogram::add(long long value) {
+	int bucket = 0;
+	for (long long rest = value; rest > 0 && bucket + 1 < BUCKET_COUNT; rest >>= 1) ++bucket;
+	++counts[bucket];
+	++total;
+	sum += double(value);
+	maximum = std::max(maximum, value);
+}
+
+long long Histogram::quantile(double fraction) const {
+	long long seen = 0;
+	for (int bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+		seen += counts[bucket];
+		if (seen >= fraction * total) return std::min(maximum, bucket == 0 ? 0 : (1LL << bucket) - 1);
+	}
+	return maximum;
+}
+
+void Histogram::print(std::ostream& out, const std::string& title, const std::string& unit) const {
+	out << title << ": " << total << " samples";
+	if (total == 0) {
+		out << std::endl;
+		return;
+	}
+	out << ", mean " << sum / total << ' ' << unit << ", p50 <= " << quantile(0.5) << ", p99 <= " << quantile(0.99)
+		<< ", max " << maximum << ' ' << unit << std::endl;
+	for (int bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+		if (counts[bucket] == 0) continue;
+		long long low = bucket == 0 ? 0 : 1LL << (bucket - 1);
+		long long high = bucket == 0 ? 0 : (1LL << bucket) - 1;
+		out << "  " << low << ".." << high << ' ' << unit << ": " << counts[bucket] << std::endl;
+	}
+}
+
+FrameProfiler::FrameProfiler() : keysPending(false), queuedPending(false) {}
+
+long long FrameProfiler::microseconds(Clock::time_point from, Clock::time_point to) {
+	return std::chrono::duration_cast<std::chrono::microseconds>(to - from).count();
+}
+
+void FrameProfiler::keysRead() {
+	keysTime = Clock::now();
+	keysPending = true;
+}
+
+void FrameProfiler::actionsQueued() {
+	queuedTime = Clock::now();
+	if (keysPending) keysToQueued.add(microseconds(keysTime, queuedTime));
+	queuedPending = true;
+}
+
+void FrameProfiler::drawStarted() {
+	drawTime = Clock::now();
+	// Only the first frame after the actions were queued waited for the game
+	if (queuedPending) queuedToDraw.add(microseconds(queuedTime, drawTime));
+	queuedPending = false;
+}
+
+void FrameProfiler::frameWritten(size_t bytes) {
+	Clock::time_point now = Clock::now();
+	drawToWritten.add(microseconds(drawTime, now));
+	if (keysPending) keysToWritten.add(microseconds(keysTime, now));
+	keysPending = false;
+	frameBytes.add((long long)bytes);
+}
+
+void FrameProfiler::report(std::ostream& out) const {
+	keysToQueued.print(out, "keys read -> actions queued", "us");
+	queuedToDraw.print(out, "actions queued -> view update", "us");
+	drawToWritten.print(out, "view update -> frame written", "us");
+	keysToWritten.print(out, "keys read -> frame written", "us");
+	frameBytes.print(out, "bytes per frame", "B");
+}
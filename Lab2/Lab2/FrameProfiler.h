@@ -0,0 +1,44 @@
+#pragma once
+#include <chrono>
+#include <ostream>
+#include <string>
+
+// Counts of values in power-of-two buckets: bucket 0 holds 0, bucket i holds [2^(i-1), 2^i)
+class Histogram {
+	static const int BUCKET_COUNT = 48;
+	long long counts[BUCKET_COUNT];
+	long long total;
+	double sum;
+	long long maximum;
+	// Upper bound of the bucket holding the given fraction of the values
+	long long quantile(double fraction) const;
+public:
+	Histogram();
+	void add(long long value);
+	void print(std::ostream& out, const std::string& title, const std::string& unit) const;
+};
+
+// Optional timing of the way from a keypress to the console. The player marks when keys arrive
+// and when their actions are queued; the view marks when Game asks it to draw and when the frame
+// is written. The first frame after a batch of keys gives the input-to-render latency.
+class FrameProfiler {
+	typedef std::chrono::steady_clock Clock;
+	Clock::time_point keysTime;
+	Clock::time_point queuedTime;
+	Clock::time_point drawTime;
+	bool keysPending;
+	bool queuedPending;
+	Histogram keysToQueued;
+	Histogram queuedToDraw;
+	Histogram drawToWritten;
+	Histogram keysToWritten;
+	Histogram frameBytes;
+	static long long microseconds(Clock::time_point from, Clock::time_point to);
+public:
+	FrameProfiler();
+	void keysRead();
+	void actionsQueued();
+	void drawStarted();
+	void frameWritten(size_t bytes);
+	void report(std::ostream& out) const;
+};
@@ -0,0 +1,349 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <type_traits>
+#include "Terminal.h"
+#include "Bitboard.h"
+#include "Fleet.h"
+#include "RingQueue.h"
+
+enum CellType { EMPTY_CELL, EMPTY_SHOOT_CELL, SHIP_CELL, SHIP_SHOOT_CELL, SELECTED_CELL };
+enum ActionType { SELECT_CELL, PLACE_SHIP, SHOOT, CONFIRM };
+enum GameStage { SETUP, BATTLE };
+enum ShotOutcome { SHOT_MISS, SHOT_HIT, SHOT_SUNK };
+
+// One gamer's field: where the ships stand and which cells were shot at
+struct FieldBoard {
+	Bitboard ships;
+	Bitboard shots;
+	CellType cellAt(int cell) const {
+		if (shots.test(cell)) return ships.test(cell) ? SHIP_SHOOT_CELL : EMPTY_SHOOT_CELL;
+		return ships.test(cell) ? SHIP_CELL : EMPTY_CELL;
+	}
+	// What the enemy is allowed to see: shots, and ships only where they were hit
+	FieldBoard enemyView() const {
+		return FieldBoard{ ships & shots, shots };
+	}
+	bool allShipsSunk() const {
+		return ships.andNot(shots).none();
+	}
+	// Cells of the ship standing on the given cell: its side-connected group of ship cells
+	Bitboard shipAt(int cell, COORD fieldSize) const {
+		Bitboard ship;
+		if (!ships.test(cell)) return ship;
+		int stack[MAX_FIELD_CELLS];
+		int stackSize = 0;
+		ship.set(cell);
+		stack[stackSize++] = cell;
+		while (stackSize != 0) {
+			int current = stack[--stackSize];
+			int x = current % fieldSize.X;
+			int neighbours[4] = { x > 0 ? current - 1 : -1, x < fieldSize.X - 1 ? current + 1 : -1,
+				current - fieldSize.X, current + fieldSize.X < fieldSize.X * fieldSize.Y ? current + fieldSize.X : -1 };
+			for (int neighbour : neighbours) {
+				if (neighbour < 0 || !ships.test(neighbour) || ship.test(neighbour)) continue;
+				ship.set(neighbour);
+				stack[stackSize++] = neighbour;
+			}
+		}
+		return ship;
+	}
+};
+
+// A gamer's move: a plain value that is copied freely and never owns memory
+class Action {
+	ActionType type;
+	bool hasTarget;
+	COORD targetCell;
+public:
+	Action() : type(CONFIRM), hasTarget(false) {
+		targetCell.X = targetCell.Y = 0;
+	}
+	explicit Action(ActionType type) : type(type), hasTarget(false) {
+		targetCell.X = targetCell.Y = 0;
+	}
+	Action(ActionType type, COORD targetCell) : type(type), hasTarget(true), targetCell(targetCell) {}
+	operator ActionType() const {
+		return type;
+	}
+	// nullptr for an action without a target, e.g. CONFIRM
+	const COORD* getTargetCell() const {
+		return hasTarget ? &targetCell : nullptr;
+	}
+};
+static_assert(std::is_trivially_copyable<Action>::value, "Action must stay a plain value");
+
+const size_t ACTION_QUEUE_CAPACITY = 256;
+typedef RingQueue<Action, ACTION_QUEUE_CAPACITY> ActionQueue;
+
+class Gamer {
+protected:
+	std::string name;
+public:
+	std::string getName() const {
+		return name;
+	}
+	// Called when the queue is empty during the gamer's turn. Pushes at least one action, waiting
+	// for input if needed, and may push all the actions it already knows, e.g. every key read at once.
+	// The actions still queued when the turn ends are dropped.
+	virtual void act(GameStage stage, ActionQueue& actions) = 0;
+	// Called after each shot of this gamer at a cell that was not shot before
+	virtual void shotResult(COORD, ShotOutcome) {}
+	// Called when the gamer starts firing at another fleet because its enemy was sunk. Then
+	// shotResult is called for every shot fired at the new enemy so far, in order.
+	virtual void enemyChanged() {}
+	// The game is drawn for the human gamers only, so no computer's fleet is ever shown
+	virtual bool isHuman() const {
+		return false;
+	}
+	virtual ~Gamer() {}
+};
+
+// Shows the fields of all gamers, each in its own slot, as the viewer may see them:
+// the viewer's own field whole, the others' only as far as they were shot at
+class GameView {
+public:
+	virtual void update(const std::vector<FieldBoard>& fields, int viewerIndex, int selectedField = -1, const COORD* selectedCell = nullptr) = 0;
+	virtual ~GameView() {}
+};
+
+// View for games nobody watches, e.g. self-play simulation
+class NullView : public GameView {
+public:
+	virtual void update(const std::vector<FieldBoard>&, int, int = -1, const COORD* = nullptr) {}
+};
+
+// Receives everything needed to replay a game: each confirmed layout and every battle action
+class GameObserver {
+public:
+	virtual void fieldReady(int gamerIndex, const Bitboard& ships) = 0;
+	virtual void actionTaken(int gamerIndex, ActionType type, COORD cell) = 0;
+	virtual void gameOver(int winnerIndex) = 0;
+	virtual ~GameObserver() {}
+};
+
+const int MAX_GAMERS = 32;
+
+// Two or more gamers set up their fleets in turn, then fire in turn, each at the next gamer
+// in turn order whose fleet is still afloat. The last fleet afloat wins.
+class Game {
+private:
+	std::vector<Gamer*> gamers;
+	std::vector<FieldBoard> fields;
+	// Per field, the cells shot at in firing order, for gamers that take it over as their enemy
+	std::vector<std::vector<int>> shotOrders;
+	std::vector<int> enemies;
+	std::vector<int> shotCounts;
+	int winnerIndex;
+	GameView* display;
+	GameObserver* observer;
+	COORD fieldSize;
+	FieldMasks fieldMasks;
+	Fleet fleet;
+	ActionQueue actions;
+	GameStage stage;
+	int currentGamerIndex;
+	COORD selectedCell;
+	// The human who acted last, or the first human before anyone acted; -1 without humans
+	int viewerIndex;
+	bool finished;
+	bool fieldIsReady(const FieldBoard& field) {
+		return isValidFleet(field.ships, fieldMasks, fleet.counts);
+	}
+	bool gameFinished() {
+		int fleetsAfloat = 0;
+		for (const FieldBoard& field : fields) {
+			if (!field.allShipsSunk()) ++fleetsAfloat;
+		}
+		return fleetsAfloat <= 1;
+	}
+	// The first gamer after gamerIndex in turn order whose fleet is afloat
+	int nextAfloat(int gamerIndex) const {
+		int gamerCount = int(gamers.size());
+		for (int step = 1; step < gamerCount; ++step) {
+			int index = (gamerIndex + step) % gamerCount;
+			if (!fields[index].allShipsSunk()) return index;
+		}
+		return gamerIndex;
+	}
+	ShotOutcome fireAt(FieldBoard& enemyField, int cell) {
+		enemyField.shots.set(cell);
+		if (!enemyField.ships.test(cell)) return SHOT_MISS;
+		return enemyField.shipAt(cell, fieldSize).andNot(enemyField.shots).none() ? SHOT_SUNK : SHOT_HIT;
+	}
+	COORD cellCoord(int cell) const {
+		COORD coord;
+		coord.X = short(cell % fieldSize.X);
+		coord.Y = short(cell / fieldSize.X);
+		return coord;
+	}
+	int firstHuman() const {
+		for (size_t i = 0; i < gamers.size(); ++i) {
+			if (gamers[i]->isHuman()) return int(i);
+		}
+		return -1;
+	}
+	// Tells the gamer the results of every shot already fired at its new enemy
+	void changeEnemy(int gamerIndex, int enemyIndex) {
+		enemies[gamerIndex] = enemyIndex;
+		gamers[gamerIndex]->enemyChanged();
+		FieldBoard replayed;
+		replayed.ships = fields[enemyIndex].ships;
+		for (int cell : shotOrders[enemyIndex]) gamers[gamerIndex]->shotResult(cellCoord(cell), fireAt(replayed, cell));
+	}
+	// Draws the fields after an action of the gamer. The cursor of a computer is shown only
+	// on fields the viewer may see whole or as far as they were shot, never on its own fleet.
+	void show(int gamerIndex, int selectedField) {
+		if (gamers[gamerIndex]->isHuman()) viewerIndex = gamerIndex;
+		if (gamerIndex == viewerIndex || selectedField != gamerIndex) display->update(fields, viewerIndex, selectedField, &selectedCell);
+		else display->update(fields, viewerIndex);
+	}
+	// Applies one action of the gamer whose turn it is. Returns false when the action ends the turn.
+	// The target, if any, has been checked by play.
+	bool dispatch(int gamerIndex, Action move) {
+		bool continueCond = true;
+		const COORD* targetCell = move.getTargetCell();
+		if (stage == SETUP) {
+			switch (move) {
+			case SELECT_CELL:
+				if (targetCell != nullptr) selectedCell = *targetCell;
+				show(gamerIndex, gamerIndex);
+				break;
+			case CONFIRM:
+				if (fieldIsReady(fields[gamerIndex])) {
+					continueCond = false;
+					if (observer != nullptr) observer->fieldReady(gamerIndex, fields[gamerIndex].ships);
+				}
+				break;
+			case PLACE_SHIP:
+				if (targetCell != nullptr) selectedCell = *targetCell;
+				fields[gamerIndex].ships.flip(fieldSize.X * selectedCell.Y + selectedCell.X);
+				show(gamerIndex, gamerIndex);
+				break;
+			default:
+				break;
+			}
+			return continueCond;
+		}
+		int enemyIndex = enemies[gamerIndex];
+		switch (move) {
+		case SELECT_CELL:
+			if (targetCell != nullptr) selectedCell = *targetCell;
+			show(gamerIndex, enemyIndex);
+			break;
+		case SHOOT: {
+			if (targetCell != nullptr) selectedCell = *targetCell;
+			FieldBoard& enemyField = fields[enemyIndex];
+			int cell = fieldSize.X * selectedCell.Y + selectedCell.X;
+			if (!enemyField.shots.test(cell)) {
+				ShotOutcome outcome = fireAt(enemyField, cell);
+				shotOrders[enemyIndex].push_back(cell);
+				++shotCounts[gamerIndex];
+				gamers[gamerIndex]->shotResult(selectedCell, outcome);
+				if (outcome == SHOT_MISS || enemyField.allShipsSunk()) continueCond = false;
+			}
+			show(gamerIndex, enemyIndex);
+			break;
+		}
+		default:
+			break;
+		}
+		if (observer != nullptr) observer->actionTaken(gamerIndex, move, selectedCell);
+		return continueCond;
+	}
+	// Starts the turn of the gamer. A battle turn first checks whether the game is over.
+	void beginTurn(int gamerIndex) {
+		currentGamerIndex = gamerIndex;
+		selectedCell.X = selectedCell.Y = 0;
+		actions.clear();
+		if (stage == SETUP) return;
+		if (gameFinished()) {
+			finish();
+			return;
+		}
+		int enemyIndex = nextAfloat(gamerIndex);
+		if (enemyIndex != enemies[gamerIndex]) changeEnemy(gamerIndex, enemyIndex);
+	}
+	void finish() {
+		finished = true;
+		for (size_t i = 0; i < fields.size(); ++i) {
+			if (!fields[i].allShipsSunk()) winnerIndex = int(i);
+		}
+		if (observer != nullptr) observer->gameOver(winnerIndex);
+	}
+public:
+	// Throws invalid_argument if the field is too large or there are fewer than 2 or more than MAX_GAMERS gamers
+	Game(GameView* display, const std::vector<Gamer*>& gamers, COORD fieldSize)
+		: gamers(gamers), winnerIndex(-1), display(display), observer(nullptr), fieldSize(fieldSize), fieldMasks(fieldSize), fleet(fleetForField(fieldSize)), stage(SETUP), currentGamerIndex(0), finished(false) {
+		if (gamers.size() < 2 || gamers.size() > size_t(MAX_GAMERS)) throw std::invalid_argument("a game needs 2 to " + std::to_string(MAX_GAMERS) + " gamers");
+		fields.resize(gamers.size());
+		shotOrders.resize(gamers.size());
+		// Reserved up front, so shots never allocate
+		for (std::vector<int>& shotOrder : shotOrders) shotOrder.reserve(fieldSize.X * fieldSize.Y);
+		shotCounts.resize(gamers.size());
+		for (size_t i = 0; i < gamers.size(); ++i) enemies.push_back(int((i + 1) % gamers.size()));
+		selectedCell.X = selectedCell.Y = 0;
+		viewerIndex = firstHuman();
+	}
+	Game(GameView* display, Gamer* gamer1, Gamer* gamer2, COORD fieldSize) : Game(display, std::vector<Gamer*>{ gamer1, gamer2 }, fieldSize) {}
+	void setObserver(GameObserver* observer) {
+		this->observer = observer;
+	}
+	// Starts with the setup of the first gamer. From then on the game is driven by play, either
+	// from run or by a caller that receives the actions itself, e.g. from the network.
+	void start() {
+		stage = SETUP;
+		finished = false;
+		winnerIndex = -1;
+		viewerIndex = firstHuman();
+		beginTurn(0);
+	}
+	// Applies an action of the gamer whose turn it is and moves on to the next turn when the action
+	// ends this one. Returns false without doing anything for another gamer, a finished game,
+	// a SELECT_CELL without a target or a target outside the field.
+	bool play(int gamerIndex, Action move) {
+		if (finished || gamerIndex != currentGamerIndex) return false;
+		const COORD* targetCell = move.getTargetCell();
+		if (targetCell == nullptr && move == SELECT_CELL) return false;
+		if (targetCell != nullptr && (targetCell->X < 0 || targetCell->X >= fieldSize.X || targetCell->Y < 0 || targetCell->Y >= fieldSize.Y)) return false;
+		if (dispatch(gamerIndex, move)) return true;
+		if (stage == BATTLE) beginTurn(nextAfloat(gamerIndex));
+		else if (gamerIndex + 1 < int(gamers.size())) beginTurn(gamerIndex + 1);
+		else {
+			stage = BATTLE;
+			beginTurn(0);
+		}
+		return true;
+	}
+	// Plays the whole game. One loop for every kind of gamer: it asks the gamer whose turn it is
+	// for actions only when the queue runs dry.
+	void run(){
+		start();
+		while (!finished) {
+			if (actions.empty()) gamers[currentGamerIndex]->act(stage, actions);
+			if (actions.empty()) throw std::logic_error(gamers[currentGamerIndex]->getName() + " gave no action");
+			play(currentGamerIndex, actions.pop());
+		}
+	}
+	bool isFinished() const {
+		return finished;
+	}
+	GameStage getStage() const {
+		return stage;
+	}
+	int getCurrentGamerIndex() const {
+		return currentGamerIndex;
+	}
+	int getGamerCount() const {
+		return int(gamers.size());
+	}
+	// Index of the gamer whose ships survived, or -1 if the game was not played or nobody had ships
+	int getWinnerIndex() const {
+		return winnerIndex;
+	}
+	// Number of shots the gamer fired at cells not shot before
+	int getShotCount(int gamerIndex) const {
+		return shotCounts[gamerIndex];
+	}
+};
@@ -0,0 +1,143 @@
+#include "GameRecord.h"
+#include <stdexcept>
+#include <algorithm>
+#include <iterator>
+
+namespace {
+	const char MAGIC[4] = { 'B', 'S', 'H', 'R' };
+	const int LAYOUT_RECORD = 4;
+	const int END_RECORD = 5;
+
+	char recordHead(int gamerIndex, int kind) {
+		return char((gamerIndex << 3) | kind);
+	}
+}
+
+GameRecorder::GameRecorder(const std::string& path, COORD fieldSize, int gamerCount)
+	: file(path, std::ios::binary), used(0), cellCount(fieldSize.X * fieldSize.Y) {
+	if (!file.is_open()) throw std::runtime_error("cannot create game log " + path);
+	if (fieldSize.X > 255 || fieldSize.Y > 255 || gamerCount > GAME_LOG_MAX_GAMERS) throw std::runtime_error("the game does not fit the log format");
+	char header[8] = { MAGIC[0], MAGIC[1], MAGIC[2], MAGIC[3], char(GAME_LOG_VERSION), char(fieldSize.X), char(fieldSize.Y), char(gamerCount) };
+	put(header, sizeof(header));
+}
+
+void GameRecorder::put(const char* data, size_t size) {
+	if (used + size > BUFFER_SIZE) flush();
+	for (size_t i = 0; i < size; ++i) buffer[used++] = data[i];
+}
+
+void GameRecorder::flush() {
+	file.write(buffer, used);
+	used = 0;
+	if (!file) throw std::runtime_error("cannot write game log");
+}
+
+void GameRecorder::fieldReady(int gamerIndex, const Bitboard& ships) {
+	char head = recordHead(gamerIndex, LAYOUT_RECORD);
+	put(&head, 1);
+	for (int first = 0; first < cellCount; first += 8) {
+		char bits = 0;
+		for (int cell = first; cell < first + 8 && cell < cellCount; ++cell) {
+			if (ships.test(cell)) bits |= char(1 << (cell - first));
+		}
+		put(&bits, 1);
+	}
+}
+
+void GameRecorder::actionTaken(int gamerIndex, ActionType type, COORD cell) {
+	char record[3] = { recordHead(gamerIndex, type), char(cell.X), char(cell.Y) };
+	put(record, sizeof(record));
+}
+
+void GameRecorder::gameOver(int winnerIndex) {
+	char record[2] = { recordHead(0, END_RECORD), char(winnerIndex + 1) };
+	put(record, sizeof(record));
+	flush();
+}
+
+GameRecorder::~GameRecorder() {
+	try {
+		flush();
+	}
+	catch (std::runtime_error&) {}
+}
+
+GameLog::GameLog(const std::string& path) : finished(false), winnerIndex(-1) {
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) throw std::runtime_error("cannot open game log " + path);
+	std::vector<char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+	if (data.size() < 8 || !std::equal(MAGIC, MAGIC + 4, data.begin())) throw std::runtime_error(path + " is not a game log");
+	if (data[4] != GAME_LOG_VERSION) throw std::runtime_error(path + ": unsupported game log version");
+	fieldSize.X = short((unsigned char)(data[5]));
+	fieldSize.Y = short((unsigned char)(data[6]));
+	int cellCount = fieldSize.X * fieldSize.Y;
+	if (cellCount > MAX_FIELD_CELLS) throw std::runtime_error(path + ": the field is too large");
+	layouts.resize((unsigned char)(data[7]));
+	size_t layoutBytes = size_t(cellCount + 7) / 8;
+	for (size_t pos = 8; pos < data.size();) {
+		int gamerIndex = (unsigned char)(data[pos]) >> 3;
+		int kind = data[pos] & 7;
+		if (kind == END_RECORD) {
+			if (pos + 2 > data.size()) break;
+			finished = true;
+			winnerIndex = int((unsigned char)(data[pos + 1])) - 1;
+			pos += 2;
+			continue;
+		}
+		if (gamerIndex >= int(layouts.size())) throw std::runtime_error(path + ": damaged record");
+		if (kind == LAYOUT_RECORD) {
+			if (pos + 1 + layoutBytes > data.size()) break;
+			for (int cell = 0; cell < cellCount; ++cell) {
+				if ((data[pos + 1 + cell / 8] >> (cell % 8)) & 1) layouts[gamerIndex].set(cell);
+			}
+			pos += 1 + layoutBytes;
+		}
+		else if (kind <= CONFIRM) {
+			if (pos + 3 > data.size()) break;
+			RecordedAction action;
+			action.gamerIndex = gamerIndex;
+			action.type = ActionType(kind);
+			action.cell.X = short((unsigned char)(data[pos + 1]));
+			action.cell.Y = short((unsigned char)(data[pos + 2]));
+			if (action.cell.X >= fieldSize.X || action.cell.Y >= fieldSize.Y) throw std::runtime_error(path + ": damaged record");
+			actions.push_back(action);
+			pos += 3;
+		}
+		else throw std::runtime_error(path + ": damaged record");
+	}
+}
+
+ReplayGamer::ReplayGamer(const GameLog& log, int gamerIndex, KeyboardInput* stepKeyboard)
+	: log(log), gamerIndex(gamerIndex), nextAction(0), fleetPlaced(false), stepKeyboard(stepKeyboard) {
+	name = "replay " + std::to_string(gamerIndex + 1);
+}
+
+void ReplayGamer::act(GameStage stage, ActionQueue& actions) {
+	if (stage == SETUP) {
+		if (!fleetPlaced) {
+			const Bitboard& ships = log.layouts[gamerIndex];
+			for (int cell = ships.next(0); cell != -1; cell = ships.next(cell + 1)) {
+				COORD coord;
+				coord.X = short(cell % log.fieldSize.X);
+				coord.Y = short(cell / log.fieldSize.X);
+				placement.push_back(coord);
+			}
+			fleetPlaced = true;
+		}
+		for (; !placement.empty() && !actions.full(); placement.pop_back()) actions.push(Action(PLACE_SHIP, placement.back()));
+		if (placement.empty()) actions.push(Action(CONFIRM));
+		return;
+	}
+	while (nextAction < log.actions.size() && log.actions[nextAction].gamerIndex != gamerIndex) ++nextAction;
+	if (nextAction == log.actions.size()) throw std::runtime_error("the game log ends before the game does");
+	if (stepKeyboard != nullptr) {
+		stepKeyboard->readKey();
+		actions.push(Action(log.actions[nextAction].type, log.actions[nextAction].cell));
+		++nextAction;
+		return;
+	}
+	// Without stepping, the rest of the recorded turn at once
+	for (; nextAction < log.actions.size() && log.actions[nextAction].gamerIndex == gamerIndex && !actions.full(); ++nextAction) {
+		actions.push(Action(log.actions[nextAction].type, log.actions[nextAction].cell));
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <fstream>
+#include <string>
+#include <vector>
+#include "Game.h"
+
+// Binary game log. An 8-byte header ("BSHR", version, field width, field height, gamer count)
+// is followed by records whose first byte holds the gamer index in the upper five bits and
+// the record kind in the lower three:
+//   0..3  an Action of that ActionType, then the target cell X and Y bytes (3 bytes in total)
+//   4     a gamer's confirmed layout, then one bit per cell, lowest cell first
+//   5     end of game, then the winner index + 1 (0 if there is none)
+const int GAME_LOG_VERSION = 1;
+const int GAME_LOG_MAX_GAMERS = 32;
+
+// Writes the log of a game through a fixed buffer, so recording a move never allocates.
+// Throws runtime_error if the file cannot be written.
+class GameRecorder : public GameObserver {
+	static const size_t BUFFER_SIZE = 4096;
+	std::ofstream file;
+	char buffer[BUFFER_SIZE];
+	size_t used;
+	int cellCount;
+	void put(const char* data, size_t size);
+	void flush();
+public:
+	GameRecorder(const std::string& path, COORD fieldSize, int gamerCount);
+	GameRecorder(const GameRecorder&) = delete;
+	GameRecorder& operator=(const GameRecorder&) = delete;
+	virtual void fieldReady(int gamerIndex, const Bitboard& ships);
+	virtual void actionTaken(int gamerIndex, ActionType type, COORD cell);
+	virtual void gameOver(int winnerIndex);
+	~GameRecorder();
+};
+
+struct RecordedAction {
+	int gamerIndex;
+	ActionType type;
+	COORD cell;
+};
+
+// A whole log read into memory. Throws runtime_error for a damaged or foreign file.
+struct GameLog {
+	COORD fieldSize;
+	std::vector<Bitboard> layouts;
+	std::vector<RecordedAction> actions;
+	bool finished;
+	int winnerIndex;
+	explicit GameLog(const std::string& path);
+};
+
+// Plays one gamer's side of a recorded game: places the recorded layout, then repeats the
+// recorded actions. With a keyboard it waits for a key before each battle action.
+class ReplayGamer : public Gamer {
+	const GameLog& log;
+	int gamerIndex;
+	size_t nextAction;
+	std::vector<COORD> placement;
+	bool fleetPlaced;
+	KeyboardInput* stepKeyboard;
+public:
+	ReplayGamer(const GameLog& log, int gamerIndex, KeyboardInput* stepKeyboard = nullptr);
+	virtual void act(GameStage stage, ActionQueue& actions);
+};
@@ -0,0 +1,460 @@
+#include "GameServer.h"
+#include "Protocol.h"
+#include <stdexcept>
+#ifdef __linux__
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <unordered_map>
+#include <chrono>
+#include <cerrno>
+#include <csignal>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#endif
+
+GameServer::GameServer(const std::string& socketPath, unsigned threadCount, COORD fieldSize, int gamersPerGame)
+	: socketPath(socketPath), threadCount(threadCount == 0 ? 1 : threadCount), fieldSize(fieldSize), gamersPerGame(gamersPerGame) {
+	if (fieldSize.X < 1 || fieldSize.Y < 1 || fieldSize.X > 255 || fieldSize.Y > 255) throw std::invalid_argument("the field does not fit the protocol");
+	FieldMasks checkedField(fieldSize);
+	if (gamersPerGame < 2 || gamersPerGame > MAX_GAMERS) throw std::invalid_argument("a game needs 2 to " + std::to_string(MAX_GAMERS) + " gamers");
+}
+
+#ifndef __linux__
+
+ServerReport GameServer::run() {
+	throw std::runtime_error("the game server needs Linux");
+}
+
+#else
+
+namespace {
+	const int EVENT_BATCH = 256;
+	const size_t READ_SIZE = 4096;
+	// epoll tags of the descriptors that are not connections
+	const uint64_t LISTENER_TAG = 0;
+	const uint64_t WAKEUP_TAG = 1;
+	const uint64_t SIGNAL_TAG = 2;
+	const uint64_t FIRST_CONNECTION_TAG = 3;
+
+	// One gamer's socket. The read side belongs to the loop thread; the outbox is filled by the
+	// worker of the gamer's game and written out by the loop thread.
+	struct Connection {
+		int fd;
+		uint64_t tag;
+		uint8_t partial[MESSAGE_SIZE];
+		int partialSize;
+		// -1 while the connection waits for a game
+		long long gameId;
+		int seat;
+		bool writesWatched;
+		std::mutex outboxGuard;
+		std::string outbox;
+		bool closeWhenFlushed;
+		bool closed;
+		Connection(int fd, uint64_t tag)
+			: fd(fd), tag(tag), partialSize(0), gameId(-1), seat(0), writesWatched(false), closeWhenFlushed(false), closed(false) {}
+	};
+
+	class ServerLoop;
+
+	// A gamer at the other end of a connection: its actions arrive as messages through the server,
+	// what it learns during the game is sent back
+	class RemoteGamer : public Gamer {
+		ServerLoop& loop;
+		std::shared_ptr<Connection> connection;
+	public:
+		RemoteGamer(ServerLoop& loop, const std::shared_ptr<Connection>& connection) : loop(loop), connection(connection) {
+			name = "remote " + std::to_string(connection->tag);
+		}
+		virtual void act(GameStage, ActionQueue&) {
+			throw std::logic_error("remote gamers act through the server");
+		}
+		virtual void shotResult(COORD cell, ShotOutcome outcome);
+		virtual void enemyChanged();
+	};
+
+	struct ServerGame {
+		std::vector<std::shared_ptr<Connection>> seats;
+		std::vector<std::unique_ptr<RemoteGamer>> gamers;
+		NullView view;
+		std::unique_ptr<Game> game;
+	};
+
+	struct Task {
+		enum Kind { START, ACTION, LEAVE } kind;
+		long long gameId;
+		int seat;
+		Message message;
+		// START only: the game handed over to the worker
+		std::unique_ptr<ServerGame> game;
+	};
+
+	struct Shard {
+		std::mutex guard;
+		std::condition_variable wake;
+		std::vector<Task> tasks;
+		bool stopping;
+		// Used by the worker thread only
+		std::unordered_map<long long, std::unique_ptr<ServerGame>> games;
+		long long moves;
+		long long gamesFinished;
+		std::thread worker;
+		Shard() : stopping(false), moves(0), gamesFinished(0) {}
+	};
+
+	class ServerLoop {
+		COORD fieldSize;
+		int gamersPerGame;
+		int epollFd;
+		int listenFd;
+		int wakeFd;
+		int signalFd;
+		std::unordered_map<uint64_t, std::shared_ptr<Connection>> connections;
+		uint64_t nextTag;
+		std::vector<std::shared_ptr<Connection>> lobby;
+		long long nextGameId;
+		std::vector<std::unique_ptr<Shard>> shards;
+		// Tasks collected during one batch of events, per shard
+		std::vector<std::vector<Task>> outgoing;
+		std::mutex flushGuard;
+		std::vector<std::shared_ptr<Connection>> flushRequests;
+		ServerReport report;
+
+		static void check(bool success, const char* what) {
+			if (!success) throw std::runtime_error(std::string(what) + " failed: " + std::strerror(errno));
+		}
+		void watch(int fd, uint64_t tag, uint32_t events, int operation) {
+			epoll_event event = epoll_event();
+			event.events = events;
+			event.data.u64 = tag;
+			check(epoll_ctl(epollFd, operation, fd, &event) == 0, "epoll_ctl");
+		}
+		void post(long long gameId, Task task) {
+			outgoing[size_t(gameId % (long long)(shards.size()))].push_back(std::move(task));
+		}
+		void postLeave(const Connection& connection) {
+			Task task;
+			task.kind = Task::LEAVE;
+			task.gameId = connection.gameId;
+			task.seat = connection.seat;
+			post(connection.gameId, std::move(task));
+		}
+		void dispatchTasks() {
+			for (size_t i = 0; i < shards.size(); ++i) {
+				if (outgoing[i].empty()) continue;
+				Shard& shard = *shards[i];
+				{
+					std::lock_guard<std::mutex> lock(shard.guard);
+					for (Task& task : outgoing[i]) shard.tasks.push_back(std::move(task));
+				}
+				shard.wake.notify_one();
+				outgoing[i].clear();
+			}
+		}
+		void closeConnection(const std::shared_ptr<Connection>& connection) {
+			{
+				std::lock_guard<std::mutex> lock(connection->outboxGuard);
+				if (connection->closed) return;
+				connection->closed = true;
+				connection->outbox.clear();
+			}
+			epoll_ctl(epollFd, EPOLL_CTL_DEL, connection->fd, nullptr);
+			close(connection->fd);
+			connections.erase(connection->tag);
+			if (connection->gameId >= 0) postLeave(*connection);
+			else {
+				for (size_t i = 0; i < lobby.size(); ++i) {
+					if (lobby[i] == connection) lobby.erase(lobby.begin() + i);
+				}
+			}
+		}
+		void startGame() {
+			long long gameId = nextGameId++;
+			std::unique_ptr<ServerGame> game(new ServerGame());
+			std::vector<Gamer*> gamers;
+			for (size_t seat = 0; seat < lobby.size(); ++seat) {
+				lobby[seat]->gameId = gameId;
+				lobby[seat]->seat = int(seat);
+				game->seats.push_back(lobby[seat]);
+				game->gamers.emplace_back(new RemoteGamer(*this, lobby[seat]));
+				gamers.push_back(game->gamers.back().get());
+			}
+			game->game.reset(new Game(&game->view, gamers, fieldSize));
+			lobby.clear();
+			++report.gamesStarted;
+			Task task;
+			task.kind = Task::START;
+			task.gameId = gameId;
+			task.seat = 0;
+			task.game = std::move(game);
+			post(gameId, std::move(task));
+		}
+		void acceptConnections() {
+			for (;;) {
+				int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+				if (fd < 0) return;
+				std::shared_ptr<Connection> connection = std::make_shared<Connection>(fd, nextTag++);
+				watch(fd, connection->tag, EPOLLIN, EPOLL_CTL_ADD);
+				connections[connection->tag] = connection;
+				++report.connections;
+				lobby.push_back(connection);
+				if (int(lobby.size()) == gamersPerGame) startGame();
+			}
+		}
+		void readConnection(const std::shared_ptr<Connection>& connection) {
+			uint8_t buffer[READ_SIZE];
+			ssize_t bytesRead = recv(connection->fd, buffer, sizeof(buffer), 0);
+			if (bytesRead < 0 && (errno == EAGAIN || errno == EINTR)) return;
+			if (bytesRead <= 0) {
+				closeConnection(connection);
+				return;
+			}
+			for (ssize_t i = 0; i < bytesRead; ++i) {
+				connection->partial[connection->partialSize++] = buffer[i];
+				if (connection->partialSize < MESSAGE_SIZE) continue;
+				connection->partialSize = 0;
+				// Gamers may only speak once their game has started
+				if (connection->gameId < 0) {
+					closeConnection(connection);
+					return;
+				}
+				Task task;
+				task.kind = Task::ACTION;
+				task.gameId = connection->gameId;
+				task.seat = connection->seat;
+				for (int j = 0; j < MESSAGE_SIZE; ++j) task.message.bytes[j] = connection->partial[j];
+				post(connection->gameId, std::move(task));
+			}
+		}
+		// Writes as much of the outbox as the socket takes and watches for room for the rest
+		void flush(const std::shared_ptr<Connection>& connection) {
+			std::unique_lock<std::mutex> lock(connection->outboxGuard);
+			if (connection->closed) return;
+			size_t written = 0;
+			bool failed = false;
+			while (written < connection->outbox.size()) {
+				ssize_t result = ::send(connection->fd, connection->outbox.data() + written, connection->outbox.size() - written, MSG_NOSIGNAL);
+				if (result > 0) written += size_t(result);
+				else if (result < 0 && errno == EINTR) continue;
+				else {
+					failed = !(result < 0 && errno == EAGAIN);
+					break;
+				}
+			}
+			connection->outbox.erase(0, written);
+			bool done = connection->outbox.empty();
+			bool finished = done && connection->closeWhenFlushed;
+			lock.unlock();
+			if (failed || finished) {
+				closeConnection(connection);
+				return;
+			}
+			if (connection->writesWatched != !done) {
+				connection->writesWatched = !done;
+				watch(connection->fd, connection->tag, done ? EPOLLIN : EPOLLIN | EPOLLOUT, EPOLL_CTL_MOD);
+			}
+		}
+		void flushRequested() {
+			uint64_t count;
+			if (read(wakeFd, &count, sizeof(count)) < 0 && errno != EAGAIN) check(false, "eventfd read");
+			std::vector<std::shared_ptr<Connection>> requests;
+			{
+				std::lock_guard<std::mutex> lock(flushGuard);
+				requests.swap(flushRequests);
+			}
+			for (const std::shared_ptr<Connection>& connection : requests) flush(connection);
+		}
+		void requestFlush(const std::shared_ptr<Connection>& connection) {
+			bool first;
+			{
+				std::lock_guard<std::mutex> lock(flushGuard);
+				first = flushRequests.empty();
+				flushRequests.push_back(connection);
+			}
+			if (!first) return;
+			uint64_t one = 1;
+			if (write(wakeFd, &one, sizeof(one)) < 0 && errno != EAGAIN) check(false, "eventfd write");
+		}
+		void endGame(Shard& shard, long long gameId, int winnerIndex) {
+			ServerGame& game = *shard.games[gameId];
+			for (const std::shared_ptr<Connection>& seat : game.seats) {
+				send(seat, Message(MSG_GAME_OVER, winnerIndex + 1));
+				closeAfterFlush(seat);
+			}
+			shard.games.erase(gameId);
+		}
+		void handle(Shard& shard, Task& task) {
+			if (task.kind == Task::START) {
+				ServerGame& game = *task.game;
+				shard.games[task.gameId] = std::move(task.game);
+				game.game->start();
+				for (size_t seat = 0; seat < game.seats.size(); ++seat) send(game.seats[seat], Message(MSG_START, int(seat), fieldSize.X, fieldSize.Y));
+				send(game.seats[game.game->getCurrentGamerIndex()], Message(MSG_YOUR_TURN, game.game->getStage()));
+				return;
+			}
+			auto found = shard.games.find(task.gameId);
+			if (found == shard.games.end()) return;
+			ServerGame& game = *found->second;
+			if (task.kind == Task::LEAVE) {
+				endGame(shard, task.gameId, -1);
+				return;
+			}
+			const Message& message = task.message;
+			bool accepted = false;
+			if (message.kind() == MSG_ACTION && message[0] <= CONFIRM && message[1] < fieldSize.X && message[2] < fieldSize.Y) {
+				accepted = game.game->play(task.seat, messageAction(message));
+			}
+			if (accepted) ++shard.moves;
+			const std::shared_ptr<Connection>& actor = game.seats[task.seat];
+			if (game.game->isFinished()) {
+				send(actor, Message(MSG_ACK, accepted, 0));
+				++shard.gamesFinished;
+				endGame(shard, task.gameId, game.game->getWinnerIndex());
+				return;
+			}
+			int current = game.game->getCurrentGamerIndex();
+			send(actor, Message(MSG_ACK, accepted, current == task.seat));
+			if (accepted && current != task.seat) send(game.seats[current], Message(MSG_YOUR_TURN, game.game->getStage()));
+		}
+		void work(Shard& shard) {
+			std::vector<Task> batch;
+			for (;;) {
+				{
+					std::unique_lock<std::mutex> lock(shard.guard);
+					shard.wake.wait(lock, [&]() { return shard.stopping || !shard.tasks.empty(); });
+					if (shard.tasks.empty()) return;
+					batch.swap(shard.tasks);
+				}
+				for (Task& task : batch) handle(shard, task);
+				batch.clear();
+			}
+		}
+	public:
+		ServerLoop(COORD fieldSize, int gamersPerGame)
+			: fieldSize(fieldSize), gamersPerGame(gamersPerGame), epollFd(-1), listenFd(-1), wakeFd(-1), signalFd(-1),
+			nextTag(FIRST_CONNECTION_TAG), nextGameId(0), report(ServerReport()) {}
+		ServerLoop(const ServerLoop&) = delete;
+		ServerLoop& operator=(const ServerLoop&) = delete;
+		// Called by the workers. Messages to a closed connection are dropped.
+		void send(const std::shared_ptr<Connection>& connection, const Message& message) {
+			bool first;
+			{
+				std::lock_guard<std::mutex> lock(connection->outboxGuard);
+				if (connection->closed) return;
+				first = connection->outbox.empty();
+				connection->outbox.append(reinterpret_cast<const char*>(message.bytes), MESSAGE_SIZE);
+			}
+			// Otherwise a flush is requested already or the loop waits for room in the socket
+			if (first) requestFlush(connection);
+		}
+		void closeAfterFlush(const std::shared_ptr<Connection>& connection) {
+			{
+				std::lock_guard<std::mutex> lock(connection->outboxGuard);
+				if (connection->closed) return;
+				connection->closeWhenFlushed = true;
+			}
+			requestFlush(connection);
+		}
+		ServerReport run(const std::string& socketPath, unsigned threadCount) {
+			raiseDescriptorLimit();
+			sockaddr_un address = socketAddress(socketPath);
+			// A socket left behind by an earlier server is replaced, any other file is not
+			struct stat existing;
+			if (stat(socketPath.c_str(), &existing) == 0 && S_ISSOCK(existing.st_mode)) unlink(socketPath.c_str());
+			listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+			check(listenFd >= 0, "socket");
+			check(bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0, "bind");
+			check(listen(listenFd, SOMAXCONN) == 0, "listen");
+			epollFd = epoll_create1(EPOLL_CLOEXEC);
+			check(epollFd >= 0, "epoll_create1");
+			wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+			check(wakeFd >= 0, "eventfd");
+			// The signals are blocked before the workers start, so only the signalfd receives them
+			sigset_t signals, savedSignals;
+			sigemptyset(&signals);
+			sigaddset(&signals, SIGINT);
+			sigaddset(&signals, SIGTERM);
+			pthread_sigmask(SIG_BLOCK, &signals, &savedSignals);
+			signalFd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+			check(signalFd >= 0, "signalfd");
+			watch(listenFd, LISTENER_TAG, EPOLLIN, EPOLL_CTL_ADD);
+			watch(wakeFd, WAKEUP_TAG, EPOLLIN, EPOLL_CTL_ADD);
+			watch(signalFd, SIGNAL_TAG, EPOLLIN, EPOLL_CTL_ADD);
+			outgoing.resize(threadCount);
+			for (unsigned i = 0; i < threadCount; ++i) shards.emplace_back(new Shard());
+			for (std::unique_ptr<Shard>& shard : shards) {
+				Shard* worker = shard.get();
+				shard->worker = std::thread([this, worker]() { work(*worker); });
+			}
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			epoll_event events[EVENT_BATCH];
+			for (bool serving = true; serving;) {
+				int count = epoll_wait(epollFd, events, EVENT_BATCH, -1);
+				if (count < 0 && errno == EINTR) continue;
+				check(count >= 0, "epoll_wait");
+				for (int i = 0; i < count; ++i) {
+					uint64_t tag = events[i].data.u64;
+					if (tag == LISTENER_TAG) acceptConnections();
+					else if (tag == WAKEUP_TAG) flushRequested();
+					else if (tag == SIGNAL_TAG) {
+						// Consumed here, or it would be delivered once the mask is restored
+						signalfd_siginfo signal;
+						serving = read(signalFd, &signal, sizeof(signal)) != sizeof(signal) && errno == EAGAIN;
+					}
+					else {
+						auto found = connections.find(tag);
+						// Closed earlier in this batch
+						if (found == connections.end()) continue;
+						std::shared_ptr<Connection> connection = found->second;
+						if (events[i].events & EPOLLOUT) flush(connection);
+						if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) readConnection(connection);
+					}
+				}
+				dispatchTasks();
+			}
+			for (std::unique_ptr<Shard>& shard : shards) {
+				{
+					std::lock_guard<std::mutex> lock(shard->guard);
+					shard->stopping = true;
+				}
+				shard->wake.notify_one();
+				shard->worker.join();
+				report.moves += shard->moves;
+				report.gamesFinished += shard->gamesFinished;
+			}
+			report.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			pthread_sigmask(SIG_SETMASK, &savedSignals, nullptr);
+			unlink(socketPath.c_str());
+			return report;
+		}
+		~ServerLoop() {
+			for (auto& entry : connections) close(entry.second->fd);
+			for (int fd : { signalFd, wakeFd, epollFd, listenFd }) {
+				if (fd >= 0) close(fd);
+			}
+		}
+	};
+
+	void RemoteGamer::shotResult(COORD cell, ShotOutcome outcome) {
+		loop.send(connection, Message(MSG_SHOT, cell.X, cell.Y, outcome));
+	}
+
+	void RemoteGamer::enemyChanged() {
+		loop.send(connection, Message(MSG_ENEMY_CHANGED));
+	}
+}
+
+ServerReport GameServer::run() {
+	ServerLoop loop(fieldSize, gamersPerGame);
+	return loop.run(socketPath, threadCount);
+}
+
+#endif
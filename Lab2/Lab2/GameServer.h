@@ -0,0 +1,29 @@
+#pragma once
+#include <string>
+#include "Game.h"
+
+struct ServerReport {
+	long long connections;
+	long long gamesStarted;
+	long long gamesFinished;
+	// Actions accepted from the gamer whose turn it was
+	long long moves;
+	double seconds;
+};
+
+// Hosts games for gamers connecting to a Unix-domain socket, speaking the protocol of Protocol.h.
+// Connections are grouped into games of gamersPerGame in the order they arrive. One epoll loop
+// accepts, reads and writes every socket; the games are split by number over a pool of worker
+// threads, so the actions of one game are applied in order by one thread without locks.
+// Linux only: elsewhere run throws runtime_error.
+class GameServer {
+	std::string socketPath;
+	unsigned threadCount;
+	COORD fieldSize;
+	int gamersPerGame;
+public:
+	// Throws invalid_argument for a bad field size or gamer count
+	GameServer(const std::string& socketPath, unsigned threadCount, COORD fieldSize, int gamersPerGame);
+	// Serves until SIGINT or SIGTERM. Throws runtime_error if the socket cannot be set up.
+	ServerReport run();
+};
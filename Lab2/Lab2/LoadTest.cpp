@@ -0,0 +1,202 @@
+#include "LoadTest.h"
+#include <stdexcept>
+#ifdef __linux__
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <algorithm>
+#include <chrono>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include "Protocol.h"
+#include "Computer.h"
+#endif
+
+#ifndef __linux__
+
+LoadTestReport runLoadTest(const std::string& socketPath, int connections, double seconds, const std::string& strategy) {
+	throw std::runtime_error("the load test needs Linux");
+}
+
+#else
+
+namespace {
+	typedef std::chrono::steady_clock Clock;
+
+	const int EVENT_BATCH = 256;
+
+	// One gamer of the load test
+	struct Client {
+		int fd;
+		uint64_t tag;
+		uint8_t partial[MESSAGE_SIZE];
+		int partialSize;
+		std::unique_ptr<Computer> computer;
+		GameStage stage;
+		ActionQueue actions;
+		int seat;
+		Clock::time_point sentAt;
+		bool gameOver;
+		Client(int fd, uint64_t tag) : fd(fd), tag(tag), partialSize(0), stage(SETUP), seat(0), gameOver(false) {}
+	};
+
+	class LoadTest {
+		std::string socketPath;
+		std::string strategy;
+		int epollFd;
+		std::unordered_map<uint64_t, std::unique_ptr<Client>> clients;
+		uint64_t nextTag;
+		bool running;
+		std::vector<double> latencies;
+		LoadTestReport report;
+
+		static void check(bool success, const char* what) {
+			if (!success) throw std::runtime_error(std::string(what) + " failed: " + std::strerror(errno));
+		}
+		void connectClient() {
+			sockaddr_un address = socketAddress(socketPath);
+			int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+			check(fd >= 0, "socket");
+			// Blocking, so a full listen backlog waits instead of failing
+			if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+				close(fd);
+				check(false, "connect");
+			}
+			check(fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == 0, "fcntl");
+			std::unique_ptr<Client> client(new Client(fd, nextTag++));
+			epoll_event event = epoll_event();
+			event.events = EPOLLIN;
+			event.data.u64 = client->tag;
+			check(epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == 0, "epoll_ctl");
+			clients[client->tag] = std::move(client);
+		}
+		// Replaces the client by a new connection while the test runs
+		void closeClient(Client& client) {
+			if (!client.gameOver) ++report.dropped;
+			close(client.fd);
+			clients.erase(client.tag);
+			if (running) connectClient();
+		}
+		// The gamer has at most one action in flight, so the socket always has room for it
+		bool sendNext(Client& client) {
+			if (client.actions.empty()) client.computer->act(client.stage, client.actions);
+			Message message = actionMessage(client.actions.pop());
+			client.sentAt = Clock::now();
+			return send(client.fd, message.bytes, MESSAGE_SIZE, MSG_NOSIGNAL) == MESSAGE_SIZE;
+		}
+		// Returns false when the connection is done with
+		bool handle(Client& client, const Message& message) {
+			switch (message.kind()) {
+			case MSG_START: {
+				COORD fieldSize;
+				fieldSize.X = short(message[1]);
+				fieldSize.Y = short(message[2]);
+				client.computer = createComputer(strategy, strategy, fieldSize, client.tag, true);
+				client.stage = SETUP;
+				client.seat = message[0];
+				client.actions.clear();
+				return true;
+			}
+			case MSG_YOUR_TURN:
+				client.stage = GameStage(message[0]);
+				return sendNext(client);
+			case MSG_SHOT: {
+				COORD cell;
+				cell.X = short(message[0]);
+				cell.Y = short(message[1]);
+				client.computer->shotResult(cell, ShotOutcome(message[2]));
+				return true;
+			}
+			case MSG_ENEMY_CHANGED:
+				client.computer->enemyChanged();
+				return true;
+			case MSG_ACK:
+				if (running) {
+					latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - client.sentAt).count());
+					if (message[0]) ++report.moves;
+					else ++report.rejected;
+				}
+				return !message[1] || sendNext(client);
+			case MSG_GAME_OVER:
+				client.gameOver = true;
+				// Every game is counted once, by its first seat
+				if (running && client.seat == 0) ++report.gamesFinished;
+				return false;
+			}
+			return false;
+		}
+		void readClient(Client& client) {
+			uint8_t buffer[4096];
+			ssize_t bytesRead = recv(client.fd, buffer, sizeof(buffer), 0);
+			if (bytesRead < 0 && (errno == EAGAIN || errno == EINTR)) return;
+			if (bytesRead <= 0) {
+				closeClient(client);
+				return;
+			}
+			for (ssize_t i = 0; i < bytesRead; ++i) {
+				client.partial[client.partialSize++] = buffer[i];
+				if (client.partialSize < MESSAGE_SIZE) continue;
+				client.partialSize = 0;
+				Message message;
+				for (int j = 0; j < MESSAGE_SIZE; ++j) message.bytes[j] = client.partial[j];
+				if (!handle(client, message)) {
+					closeClient(client);
+					return;
+				}
+			}
+		}
+		static double percentile(std::vector<double>& values, double fraction) {
+			if (values.empty()) return 0;
+			size_t index = std::min(values.size() - 1, size_t(fraction * values.size()));
+			std::nth_element(values.begin(), values.begin() + index, values.end());
+			return values[index];
+		}
+	public:
+		LoadTest(const std::string& socketPath, const std::string& strategy)
+			: socketPath(socketPath), strategy(strategy), epollFd(-1), nextTag(0), running(true), report(LoadTestReport()) {}
+		LoadTest(const LoadTest&) = delete;
+		LoadTest& operator=(const LoadTest&) = delete;
+		LoadTestReport run(int connections, double seconds) {
+			raiseDescriptorLimit();
+			epollFd = epoll_create1(EPOLL_CLOEXEC);
+			check(epollFd >= 0, "epoll_create1");
+			latencies.reserve(1 << 20);
+			Clock::time_point start = Clock::now();
+			Clock::time_point end = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds));
+			for (int i = 0; i < connections; ++i) connectClient();
+			epoll_event events[EVENT_BATCH];
+			while (Clock::now() < end) {
+				int count = epoll_wait(epollFd, events, EVENT_BATCH, 100);
+				if (count < 0 && errno == EINTR) continue;
+				check(count >= 0, "epoll_wait");
+				for (int i = 0; i < count; ++i) {
+					auto found = clients.find(events[i].data.u64);
+					if (found != clients.end()) readClient(*found->second);
+				}
+			}
+			running = false;
+			report.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+			report.medianLatency = percentile(latencies, 0.5);
+			report.p99Latency = percentile(latencies, 0.99);
+			return report;
+		}
+		~LoadTest() {
+			for (auto& entry : clients) close(entry.second->fd);
+			if (epollFd >= 0) close(epollFd);
+		}
+	};
+}
+
+LoadTestReport runLoadTest(const std::string& socketPath, int connections, double seconds, const std::string& strategy) {
+	if (connections < 1) throw std::invalid_argument("the load test needs a connection");
+	// Fails early for an unknown strategy
+	COORD fieldSize;
+	fieldSize.X = fieldSize.Y = 10;
+	createComputer(strategy, strategy, fieldSize, 0);
+	LoadTest test(socketPath, strategy);
+	return test.run(connections, seconds);
+}
+
+#endif
@@ -0,0 +1,22 @@
+#pragma once
+#include <string>
+
+struct LoadTestReport {
+	long long moves;
+	// Actions the server refused; nonzero means client and server disagree about the game
+	long long rejected;
+	long long gamesFinished;
+	// Connections the server closed before the game was over
+	long long dropped;
+	double seconds;
+	// Time from sending an action to its acknowledgement, in microseconds
+	double medianLatency;
+	double p99Latency;
+};
+
+// Keeps `connections` computer gamers of the strategy connected to the game server at socketPath
+// for the given time, each reconnecting for a new game when its game is over. All of them are
+// driven by one epoll loop and have at most one action in flight.
+// Linux only: elsewhere it throws runtime_error. Throws runtime_error if the server is unreachable
+// and invalid_argument for no connections or an unknown strategy.
+LoadTestReport runLoadTest(const std::string& socketPath, int connections, double seconds, const std::string& strategy);
@@ -3,52 +3,26 @@
 #include <vector>
 #include <string>
 #include <map>
-#include <Windows.h>
+#include <algorithm>
 #include <stdexcept>
+#include <thread>
+#include <memory>
+#include <random>
+#include "Game.h"
+#include "Computer.h"
+#include "Simulator.h"
+#include "GameRecord.h"
+#include "BoardLayout.h"
+#include "GameServer.h"
+#include "LoadTest.h"
+#include "FrameProfiler.h"
+#include "SelfTest.h"
 using namespace std;
 
-enum CellType { EMPTY_CELL, EMPTY_SHOOT_CELL, SHIP_CELL, SHIP_SHOOT_CELL, SELECTED_CELL };
-enum ActionType { SELECT_CELL, PLACE_SHIP, SHOOT, CONFIRM };
-enum GameStage { SETUP, BATTLE };
-
-using CellVector = vector<CellType>;
-
-class Action {
-	ActionType type;
-	COORD* targetCell;
-public:
-	Action(ActionType type, COORD* targetCell = nullptr) :type(type) {
-		if (targetCell == nullptr) {
-			this->targetCell = nullptr;
-		}
-		else {
-			this->targetCell = new COORD(*targetCell);
-		}
-	}
-	operator ActionType() const {
-		return type;
-	}
-	COORD* getTargetCell() const {
-		return targetCell;
-	}
-	~Action() {
-		delete targetCell;
-		targetCell = nullptr;
-	}
-};
-
-class Gamer {
-protected:
-	string name;
-public:
-	string getName() const {
-		return name;
-	}
-	virtual Action act(GameStage stage) = 0;
-};
-
 class Player : public Gamer {
 	enum Side { LEFT, RIGHT, UP, DOWN };
+	KeyboardInput& keyboard;
+	FrameProfiler* profiler;
 	COORD selectedCell;
 	COORD fieldSize;
 	void moveSelectedCell(Side direction) {
@@ -67,57 +41,83 @@ class Player : public Gamer {
 			return;
 		}
 	}
+	Action keyAction(Key key, GameStage stage) {
+		switch (key) {
+		case KEY_ENTER:
+			if (stage == SETUP) return Action(CONFIRM);
+			return Action(SHOOT, selectedCell);
+		case KEY_SPACE:
+			if (stage == SETUP) return Action(PLACE_SHIP, selectedCell);
+			return Action(SHOOT, selectedCell);
+		case KEY_LEFT:
+			moveSelectedCell(LEFT);
+			break;
+		case KEY_UP:
+			moveSelectedCell(UP);
+			break;
+		case KEY_RIGHT:
+			moveSelectedCell(RIGHT);
+			break;
+		case KEY_DOWN:
+			moveSelectedCell(DOWN);
+			break;
+		}
+		return Action(SELECT_CELL, selectedCell);
+	}
 public:
-	Player(const string& name, COORD fieldSize) : fieldSize(fieldSize) {
+	Player(const string& name, COORD fieldSize, KeyboardInput& keyboard, FrameProfiler* profiler = nullptr) : keyboard(keyboard), profiler(profiler), fieldSize(fieldSize) {
 		this->name = name;
 		selectedCell.X = selectedCell.Y = 0;
 	}
-	virtual Action act(GameStage stage) {
-		HANDLE inputHandle = GetStdHandle(STD_INPUT_HANDLE);
-		INPUT_RECORD buffer[128];
-		DWORD recordsRead;
-		for (;;) {
-			ReadConsoleInput(inputHandle, buffer, DWORD(128), &recordsRead);
-			for (int i = 0; i < recordsRead; ++i) {
-				if (buffer[i].EventType == KEY_EVENT && buffer[i].Event.KeyEvent.bKeyDown) {
-					switch (buffer[i].Event.KeyEvent.wVirtualKeyCode) {
-					case 13:
-						if (stage == SETUP) return Action(CONFIRM);
-					case 32:
-						if (stage == SETUP) return Action(PLACE_SHIP, &selectedCell);
-						if (stage == BATTLE) return Action(SHOOT, &selectedCell);
-					case 37:
-						moveSelectedCell(LEFT);
-						return Action(SELECT_CELL, &selectedCell);
-					case 38:
-						moveSelectedCell(UP);
-						return Action(SELECT_CELL, &selectedCell);
-					case 39:
-						moveSelectedCell(RIGHT);
-						return Action(SELECT_CELL, &selectedCell);
-					case 40:
-						moveSelectedCell(DOWN);
-						return Action(SELECT_CELL, &selectedCell);
-					}
-				}
-			}
-		}
+	// Sleeps until keys arrive and turns every key read at once into an action
+	virtual void act(GameStage stage, ActionQueue& actions) {
+		Key keys[ACTION_QUEUE_CAPACITY];
+		int count = keyboard.readKeys(keys, int(ACTION_QUEUE_CAPACITY - actions.size()));
+		if (profiler != nullptr) profiler->keysRead();
+		for (int i = 0; i < count; ++i) actions.push(keyAction(keys[i], stage));
+		if (profiler != nullptr) profiler->actionsQueued();
+	}
+	virtual bool isHuman() const {
+		return true;
 	}
-
-};
-
-class GameView {
-public:
-	virtual void update(CellVector field1, CellVector field2, int selectedField = 0, const COORD* selectedCell = nullptr) = 0;
 };
 
+#ifdef _WIN32
 class ConsoleView : public GameView {
 	HANDLE consoleOutput;
-	CHAR_INFO* symbolArray;
-	COORD field1Pos;
-	COORD field2Pos;
+	vector<CHAR_INFO> symbolArray;
+	vector<COORD> fieldPositions;
 	COORD fieldSize;
 	COORD gameSize;
+	vector<FieldBoard> shownFields;
+	vector<FieldBoard> renderedFields;
+	bool frameDrawn;
+	FrameProfiler* profiler;
+	void drawCell(const FieldBoard& field, COORD fieldPos, int cell) {
+		int x = cell % fieldSize.X;
+		int y = cell / fieldSize.X;
+		symbolArray[gameSize.X * (y + fieldPos.Y) + fieldPos.X + x].Char.AsciiChar = getTextureChar(field.cellAt(cell));
+	}
+	// Redraws only the cells that changed since the previous frame and writes their bounding rectangle.
+	// Returns the number of bytes written.
+	size_t redrawField(const FieldBoard& field, FieldBoard& rendered, COORD fieldPos) {
+		Bitboard dirty = (field.ships ^ rendered.ships) | (field.shots ^ rendered.shots);
+		int left = fieldSize.X, top = fieldSize.Y, right = -1, bottom = -1;
+		for (int cell = dirty.next(0); cell != -1; cell = dirty.next(cell + 1)) {
+			drawCell(field, fieldPos, cell);
+			left = min(left, cell % fieldSize.X);
+			right = max(right, cell % fieldSize.X);
+			top = min(top, cell / fieldSize.X);
+			bottom = max(bottom, cell / fieldSize.X);
+		}
+		rendered = field;
+		if (right < 0) return 0;
+		COORD bufferCoord; bufferCoord.X = fieldPos.X + left; bufferCoord.Y = fieldPos.Y + top;
+		SMALL_RECT rect; rect.Left = bufferCoord.X + 1; rect.Top = bufferCoord.Y + 1;
+		rect.Right = fieldPos.X + right + 1; rect.Bottom = fieldPos.Y + bottom + 1;
+		WriteConsoleOutput(consoleOutput, symbolArray.data(), gameSize, bufferCoord, &rect);
+		return (right - left + 1) * (bottom - top + 1) * sizeof(CHAR_INFO);
+	}
 	char getTextureChar(CellType cell) {
 		switch (cell) {
 		case EMPTY_CELL:
@@ -139,61 +139,59 @@ class ConsoleView : public GameView {
 		}
 	}
 public:
-	ConsoleView(const string& fieldFramesFile, COORD field1Pos, COORD field2Pos, COORD fieldSize)
-		: field1Pos(field1Pos), field2Pos(field2Pos), fieldSize(fieldSize) {
+	explicit ConsoleView(const BoardLayout& layout, FrameProfiler* profiler = nullptr)
+		: fieldPositions(layout.fieldPositions), fieldSize(layout.fieldSize), frameDrawn(false), profiler(profiler) {
 		consoleOutput = GetStdHandle(STD_OUTPUT_HANDLE);
-		ifstream framesFile(fieldFramesFile);
-		framesFile.exceptions(ifstream::failbit);
-		if (!framesFile.is_open()) throw 1;
-		vector<string> vBuffer;
-		string sBuffer;
-		try {
-			for (;;) {
-				getline(framesFile, sBuffer);
-				vBuffer.push_back(sBuffer);
-			}
-		}
-		catch (ifstream::failure) {}
+		const vector<string>& vBuffer = layout.frame;
 		if (vBuffer.size() == 0) throw 2;
 		for (const string& str : vBuffer) {
 			if (str.length() != vBuffer[0].length()) throw 3;
 		}
 		gameSize.X = vBuffer[0].length();
 		gameSize.Y = vBuffer.size();
-		symbolArray = new CHAR_INFO[gameSize.X * gameSize.Y];
-		if (field1Pos.X + fieldSize.X > gameSize.X ||
-			field1Pos.Y + fieldSize.Y > gameSize.Y ||
-			field2Pos.X + fieldSize.X > gameSize.X ||
-			field2Pos.Y + fieldSize.Y > gameSize.Y) throw 4;
+		for (COORD fieldPos : fieldPositions) {
+			if (fieldPos.X + fieldSize.X > gameSize.X || fieldPos.Y + fieldSize.Y > gameSize.Y) throw 4;
+		}
+		symbolArray.resize(gameSize.X * gameSize.Y);
 		for (int i = 0; i < gameSize.Y; ++i) {
 			for (int j = 0; j < gameSize.X; ++j) {
 				symbolArray[i * gameSize.X + j].Attributes = FOREGROUND_BLUE | FOREGROUND_GREEN | FOREGROUND_RED;
 				symbolArray[i * gameSize.X + j].Char.AsciiChar = vBuffer[i][j];
 			}
 		}
-		for (int i = 0; i < fieldSize.Y; ++i) {
-			for (int j = 0; j < fieldSize.X; ++j) {
-				symbolArray[gameSize.X * (i + field1Pos.Y) + field1Pos.X + j].Attributes
-					= symbolArray[gameSize.X * (i + field2Pos.Y) + field2Pos.X + j].Attributes
-					= BACKGROUND_BLUE | BACKGROUND_GREEN | BACKGROUND_RED;
+		for (COORD fieldPos : fieldPositions) {
+			for (int i = 0; i < fieldSize.Y; ++i) {
+				for (int j = 0; j < fieldSize.X; ++j) {
+					symbolArray[gameSize.X * (i + fieldPos.Y) + fieldPos.X + j].Attributes = BACKGROUND_BLUE | BACKGROUND_GREEN | BACKGROUND_RED;
+				}
 			}
 		}
+		shownFields.resize(fieldPositions.size());
+		renderedFields.resize(fieldPositions.size());
 	}
-	virtual void update(CellVector field1, CellVector field2, int selectedField = 0, const COORD* selectedCell = nullptr) {
-		if (field1.size() != fieldSize.X * fieldSize.Y || field2.size() != fieldSize.X * fieldSize.Y) throw 6;
-		for (int i = 0; i < fieldSize.Y; ++i) {
-			for (int j = 0; j < fieldSize.X; ++j) {
-				symbolArray[gameSize.X * (i + field1Pos.Y) + field1Pos.X + j].Char.AsciiChar = getTextureChar(field1[fieldSize.X * i + j]);
-				symbolArray[gameSize.X * (i + field2Pos.Y) + field2Pos.X + j].Char.AsciiChar = getTextureChar(field2[fieldSize.X * i + j]);
+	virtual void update(const vector<FieldBoard>& fields, int viewerIndex, int selectedField = -1, const COORD* selectedCell = nullptr) {
+		if (fields.size() != fieldPositions.size()) throw 6;
+		if (profiler != nullptr) profiler->drawStarted();
+		size_t bytesWritten = 0;
+		for (size_t i = 0; i < fields.size(); ++i) shownFields[i] = int(i) == viewerIndex ? fields[i] : fields[i].enemyView();
+		if (frameDrawn) {
+			for (size_t i = 0; i < fields.size(); ++i) bytesWritten += redrawField(shownFields[i], renderedFields[i], fieldPositions[i]);
+		}
+		else {
+			for (size_t i = 0; i < fields.size(); ++i) {
+				for (int cell = 0; cell < fieldSize.X * fieldSize.Y; ++cell) drawCell(shownFields[i], fieldPositions[i], cell);
 			}
+			renderedFields = shownFields;
+			frameDrawn = true;
+			COORD bufferCoord; bufferCoord.X = bufferCoord.Y = 0;
+			SMALL_RECT rect; rect.Top = rect.Left = 1; rect.Right = gameSize.X + 1; rect.Bottom = gameSize.Y + 1;
+			WriteConsoleOutput(consoleOutput, symbolArray.data(), gameSize, bufferCoord, &rect);
+			bytesWritten = symbolArray.size() * sizeof(CHAR_INFO);
 		}
-		COORD bufferCoord; bufferCoord.X = bufferCoord.Y = 0;
-		SMALL_RECT rect; rect.Top = rect.Left = 1; rect.Right = gameSize.X + 1; rect.Bottom = gameSize.Y + 1;
-		WriteConsoleOutput(consoleOutput, symbolArray, gameSize, bufferCoord, &rect);
 		if (selectedCell != nullptr) {
-			if (selectedField != 0 && selectedField != 1) throw 7;
+			if (selectedField < 0 || selectedField >= int(fieldPositions.size())) throw 7;
 			if (selectedCell->X >= fieldSize.X || selectedCell->Y >= fieldSize.Y) throw 8;
-			COORD requiredFieldPosition = selectedField == 0 ? field1Pos : field2Pos;
+			COORD requiredFieldPosition = fieldPositions[selectedField];
 			COORD newPosition; newPosition.X = selectedCell->X + requiredFieldPosition.X + 1; newPosition.Y = selectedCell->Y + requiredFieldPosition.Y + 1;
 			CONSOLE_CURSOR_INFO cursor; cursor.bVisible = TRUE; cursor.dwSize = 100;
 			SetConsoleCursorInfo(consoleOutput, &cursor);
@@ -203,103 +201,414 @@ public:
 			CONSOLE_CURSOR_INFO cursor; cursor.bVisible = FALSE; cursor.dwSize = 100;
 			SetConsoleCursorInfo(consoleOutput, &cursor);
 		}
-		SMALL_RECT windowRect; windowRect.Top = windowRect.Left = 0; windowRect.Right = gameSize.X - 1; windowRect.Left = gameSize.Y - 1;
+		SMALL_RECT windowRect; windowRect.Top = windowRect.Left = 0; windowRect.Right = gameSize.X - 1; windowRect.Bottom = gameSize.Y - 1;
 		SetConsoleWindowInfo(consoleOutput, TRUE, &windowRect);
-	}
-	~ConsoleView() {
-		delete[] symbolArray;
-		symbolArray = nullptr;
+		if (profiler != nullptr) profiler->frameWritten(bytesWritten);
 	}
 };
-
-class Game {
-private:
-	vector<Gamer*> gamers;
-	map<Gamer*, CellVector> fieldStorage;
-	GameView* display;
+#else
+// VT100 terminal view. The screen is kept as one string of UTF-8 glyphs with the offset of each
+// screen cell; every frame is collected into one buffer holding cursor moves to the changed cells
+// only and sent with a single write.
+class AnsiView : public GameView {
+	string glyphs;
+	vector<int> glyphOffsets;
+	// Per screen cell, the field covering it or -1
+	vector<int> fieldAt;
+	vector<COORD> fieldPositions;
 	COORD fieldSize;
-	bool fieldIsReady(CellVector field) {
-		return true;
+	COORD gameSize;
+	vector<FieldBoard> shownFields;
+	vector<FieldBoard> renderedFields;
+	bool frameDrawn;
+	string frame;
+	int cursorX;
+	int cursorY;
+	FrameProfiler* profiler;
+	static const char* fieldStyle() {
+		return "\x1b[30;47m";
 	}
-	bool gameFinished() {
-		return false;
+	static const char* frameStyle() {
+		return "\x1b[0m";
 	}
-	CellVector getEnemyFieldView(Gamer* enemy) {
-		CellVector field = fieldStorage[enemy];
-		for (CellType& cell : field) {
-			if (cell == SHIP_CELL)cell = EMPTY_CELL;
+	const char* getTexture(CellType cell) {
+		switch (cell) {
+		case EMPTY_CELL:
+			return " ";
+		case EMPTY_SHOOT_CELL:
+			return "\xe2\x80\xa2";
+		case SHIP_CELL:
+			return "\xe2\x96\x93";
+		case SHIP_SHOOT_CELL:
+			return "X";
+		default:
+			throw 5;
 		}
-		return field;
 	}
-public:
-	Game(GameView* display, Gamer* gamer1, Gamer* gamer2, COORD fieldSize) : display(display), fieldSize(fieldSize) {
-		fieldStorage[gamer1] = CellVector(fieldSize.X * fieldSize.Y, EMPTY_CELL);
-		fieldStorage[gamer2] = CellVector(fieldSize.X * fieldSize.Y, EMPTY_CELL);
-		gamers = { gamer1, gamer2 };
-	}
-	void run(){
-		int currentGamerIndex = 0;
-		for (int i = 0; i < 2; ++i) {
-			COORD selectedCell; selectedCell.X = selectedCell.Y = 0;
-			for (bool continueCond = true; continueCond;) {
-				Action move = gamers[currentGamerIndex]->act(SETUP);
-				switch (move) {
-				case SELECT_CELL:
-					selectedCell = *move.getTargetCell();
-					display->update(fieldStorage[gamers[currentGamerIndex]], CellVector(fieldSize.X * fieldSize.Y, EMPTY_CELL), 0, &selectedCell);
-					break;
-				case CONFIRM:
-					if (fieldIsReady(fieldStorage[gamers[currentGamerIndex]])) continueCond = false;
-					break;
-				case PLACE_SHIP:
-					if (move.getTargetCell() != nullptr) selectedCell = *move.getTargetCell();
-					CellType& currentCell = fieldStorage[gamers[currentGamerIndex]][fieldSize.X * selectedCell.Y + selectedCell.X];
-					currentCell = currentCell == SHIP_CELL ? EMPTY_CELL : SHIP_CELL;
-					display->update(fieldStorage[gamers[currentGamerIndex]], CellVector(fieldSize.X * fieldSize.Y, EMPTY_CELL), 0, &selectedCell);
-					break;
+	void moveCursor(int x, int y) {
+		if (x == cursorX && y == cursorY) return;
+		frame += "\x1b[";
+		frame += to_string(y + 1);
+		frame += ';';
+		frame += to_string(x + 1);
+		frame += 'H';
+		cursorX = x;
+		cursorY = y;
+	}
+	void drawCell(const FieldBoard& field, COORD fieldPos, int cell) {
+		moveCursor(fieldPos.X + cell % fieldSize.X, fieldPos.Y + cell / fieldSize.X);
+		frame += getTexture(field.cellAt(cell));
+		++cursorX;
+	}
+	void drawWholeFrame() {
+		frame += "\x1b[2J";
+		cursorX = cursorY = -1;
+		for (int y = 0; y < gameSize.Y; ++y) {
+			moveCursor(0, y);
+			bool styled = false;
+			for (int x = 0; x < gameSize.X; ++x) {
+				int screenCell = y * gameSize.X + x;
+				int field = fieldAt[screenCell];
+				if ((field != -1) != styled) {
+					styled = !styled;
+					frame += styled ? fieldStyle() : frameStyle();
 				}
+				if (field != -1) {
+					COORD fieldPos = fieldPositions[field];
+					frame += getTexture(shownFields[field].cellAt((y - fieldPos.Y) * fieldSize.X + x - fieldPos.X));
+				}
+				else frame.append(glyphs, glyphOffsets[screenCell], glyphOffsets[screenCell + 1] - glyphOffsets[screenCell]);
 			}
-			currentGamerIndex = (currentGamerIndex + 1) % 2;
+			if (styled) frame += frameStyle();
+			cursorX = gameSize.X;
 		}
-		for (; !gameFinished();) {
-			COORD selectedCell; selectedCell.X = selectedCell.Y = 0;
-			for (bool continueCond = true; continueCond;) {
-				Action move = gamers[currentGamerIndex]->act(BATTLE);
-				switch (move) {
-				case SELECT_CELL:
-					selectedCell = *move.getTargetCell();
-					display->update(fieldStorage[gamers[currentGamerIndex]], getEnemyFieldView(gamers[(currentGamerIndex + 1) % 2]), 1, &selectedCell);
-					break;
-				case SHOOT:
-					if (move.getTargetCell() != nullptr) selectedCell = *move.getTargetCell();
-					CellType& currentCell = fieldStorage[gamers[(currentGamerIndex + 1) % 2]][fieldSize.X * selectedCell.Y + selectedCell.X];
-					switch (currentCell) {
-					case SHIP_CELL:
-						currentCell = SHIP_SHOOT_CELL;
-						break;
-					case EMPTY_CELL:
-						currentCell = EMPTY_SHOOT_CELL;
-						continueCond = false;
-						break;
-					}
-					display->update(fieldStorage[gamers[currentGamerIndex]], getEnemyFieldView(gamers[(currentGamerIndex + 1) % 2]), 1, &selectedCell);
-					break;
+	}
+	void redrawField(const FieldBoard& field, FieldBoard& rendered, COORD fieldPos) {
+		Bitboard dirty = (field.ships ^ rendered.ships) | (field.shots ^ rendered.shots);
+		for (int cell = dirty.next(0); cell != -1; cell = dirty.next(cell + 1)) drawCell(field, fieldPos, cell);
+		rendered = field;
+	}
+public:
+	explicit AnsiView(const BoardLayout& layout, FrameProfiler* profiler = nullptr)
+		: fieldPositions(layout.fieldPositions), fieldSize(layout.fieldSize), frameDrawn(false), cursorX(-1), cursorY(-1), profiler(profiler) {
+		gameSize.X = gameSize.Y = 0;
+		for (const string& line : layout.frame) {
+			// One screen cell per UTF-8 code point
+			int width = 0;
+			for (size_t i = 0; i < line.length(); ++i) {
+				if ((line[i] & 0xC0) != 0x80) {
+					glyphOffsets.push_back(int(glyphs.length()));
+					++width;
 				}
+				glyphs += line[i];
+			}
+			if (gameSize.Y == 0) gameSize.X = width;
+			else if (width != gameSize.X) throw 3;
+			++gameSize.Y;
+		}
+		glyphOffsets.push_back(int(glyphs.length()));
+		if (gameSize.Y == 0) throw 2;
+		fieldAt.assign(gameSize.X * gameSize.Y, -1);
+		for (size_t i = 0; i < fieldPositions.size(); ++i) {
+			COORD fieldPos = fieldPositions[i];
+			if (fieldPos.X + fieldSize.X > gameSize.X || fieldPos.Y + fieldSize.Y > gameSize.Y) throw 4;
+			for (int y = 0; y < fieldSize.Y; ++y) {
+				for (int x = 0; x < fieldSize.X; ++x) fieldAt[(fieldPos.Y + y) * gameSize.X + fieldPos.X + x] = int(i);
 			}
-			currentGamerIndex = (currentGamerIndex + 1) % 2;
 		}
+		shownFields.resize(fieldPositions.size());
+		renderedFields.resize(fieldPositions.size());
+	}
+	virtual void update(const vector<FieldBoard>& fields, int viewerIndex, int selectedField = -1, const COORD* selectedCell = nullptr) {
+		if (fields.size() != fieldPositions.size()) throw 6;
+		if (profiler != nullptr) profiler->drawStarted();
+		for (size_t i = 0; i < fields.size(); ++i) shownFields[i] = int(i) == viewerIndex ? fields[i] : fields[i].enemyView();
+		frame.clear();
+		if (frameDrawn) {
+			frame += fieldStyle();
+			for (size_t i = 0; i < fields.size(); ++i) redrawField(shownFields[i], renderedFields[i], fieldPositions[i]);
+			frame += frameStyle();
+		}
+		else {
+			drawWholeFrame();
+			renderedFields = shownFields;
+			frameDrawn = true;
+		}
+		if (selectedCell != nullptr) {
+			if (selectedField < 0 || selectedField >= int(fieldPositions.size())) throw 7;
+			if (selectedCell->X >= fieldSize.X || selectedCell->Y >= fieldSize.Y) throw 8;
+			COORD requiredFieldPosition = fieldPositions[selectedField];
+			moveCursor(requiredFieldPosition.X + selectedCell->X, requiredFieldPosition.Y + selectedCell->Y);
+			frame += "\x1b[?25h";
+		}
+		else {
+			frame += "\x1b[?25l";
+		}
+		writeToTerminal(frame);
+		if (profiler != nullptr) profiler->frameWritten(frame.length());
+	}
+	~AnsiView() {
+		frame = frameStyle();
+		moveCursor(0, gameSize.Y);
+		frame += "\x1b[?25h\n";
+		writeToTerminal(frame);
 	}
 };
+#endif
 
-int main(int argc, char** argv) {
-	COORD fieldSize; fieldSize.X = fieldSize.Y = 10;
-	COORD field1Pos, field2Pos;
-	field1Pos.X = field1Pos.Y = 2;
-	field2Pos.X = 15; field2Pos.Y = 2;
-	Player p1("P1", fieldSize);
-	Player p2("P2", fieldSize);
-	ConsoleView display("FieldFrames.txt", field1Pos, field2Pos, fieldSize);
-	Game game(&display, &p1, &p2, fieldSize);
-	game.run();
+#ifdef _WIN32
+typedef ConsoleView TerminalView;
+#else
+typedef AnsiView TerminalView;
+#endif
+
+// FieldFrames.txt when it was drawn for this game, a generated grid otherwise
+BoardLayout defaultLayout(COORD fieldSize, int gamerCount) {
+	try {
+		BoardLayout layout = loadLayout("FieldFrames.txt");
+		if (layout.fieldSize.X == fieldSize.X && layout.fieldSize.Y == fieldSize.Y && int(layout.fieldPositions.size()) == gamerCount) return layout;
+	}
+	catch (runtime_error&) {}
+	return gridLayout(fieldSize, gamerCount);
+}
+
+// Reads the arguments after argv[i] up to the next option
+vector<string> optionValues(int argc, char** argv, int& i) {
+	vector<string> values;
+	while (i + 1 < argc && string(argv[i + 1]).compare(0, 2, "--") != 0) values.push_back(argv[++i]);
+	return values;
+}
+
+// Fails with a usage error unless the field is at least 1x1 and its fleet (see fleetForField) fits on it
+void checkFieldSize(COORD fieldSize) {
+	string size = to_string(fieldSize.X) + "x" + to_string(fieldSize.Y);
+	if (fieldSize.X < 1 || fieldSize.Y < 1) throw invalid_argument("usage: the field must be at least 1x1, not " + size);
+	FleetGenerator generator(fieldSize);
+	mt19937_64 random(0);
+	try {
+		generator.generate(random);
+	}
+	catch (invalid_argument&) {
+		throw invalid_argument("usage: the fleet does not fit a " + size + " field");
+	}
+}
+
+// Reads the W H arguments of --size at argv[i]
+COORD readFieldSize(char** argv, int& i) {
+	COORD fieldSize;
+	fieldSize.X = short(stoi(argv[++i]));
+	fieldSize.Y = short(stoi(argv[++i]));
+	checkFieldSize(fieldSize);
+	return fieldSize;
+}
+
+// Lab2 --simulate <games> [--threads N] [--seed S] [--size W H] [--gamers STRATEGY...] [--record-game N FILE]
+int simulate(int argc, char** argv) {
+	try {
+		if (argc < 3) throw invalid_argument("usage: Lab2 --simulate <games> [--threads N] [--seed S] [--size W H] [--gamers STRATEGY...] [--record-game N FILE]");
+		long long games = stoll(argv[2]);
+		unsigned threadCount = thread::hardware_concurrency();
+		uint64_t seed = 1;
+		COORD fieldSize; fieldSize.X = fieldSize.Y = 10;
+		vector<string> strategies = { "hunt", "random" };
+		long long recordedGame = -1;
+		string recordPath;
+		for (int i = 3; i < argc; ++i) {
+			string option = argv[i];
+			if (option == "--threads" && i + 1 < argc) threadCount = stoul(argv[++i]);
+			else if (option == "--seed" && i + 1 < argc) seed = stoull(argv[++i]);
+			else if (option == "--size" && i + 2 < argc) fieldSize = readFieldSize(argv, i);
+			else if (option == "--gamers") strategies = optionValues(argc, argv, i);
+			else if (option == "--record-game" && i + 2 < argc) {
+				recordedGame = stoll(argv[++i]);
+				recordPath = argv[++i];
+			}
+			else throw invalid_argument("unknown option " + option);
+		}
+		if (threadCount == 0) threadCount = 1;
+		Simulator simulator(strategies, fieldSize, seed);
+		if (recordedGame >= 0) {
+			GameRecorder recorder(recordPath, fieldSize, int(strategies.size()));
+			simulator.replayGame(recordedGame, recorder);
+			cout << "game " << recordedGame << " recorded to " << recordPath << endl;
+			return 0;
+		}
+		SimulationReport report = simulator.run(games, threadCount);
+		cout << report.games << " games on " << threadCount << " threads in " << report.seconds << " s, "
+			<< report.games / report.seconds << " games/s, " << report.draws << " draws" << endl;
+		for (size_t i = 0; i < strategies.size(); ++i) {
+			cout << "gamer " << i + 1 << " (" << strategies[i] << "): "
+				<< 100.0 * report.wins[i] / max(report.games, 1LL) << "% wins, "
+				<< double(report.winningShots[i]) / max(report.wins[i], 1LL) << " shots to win on average" << endl;
+		}
+	}
+	catch (exception& errInfo) {
+		cout << errInfo.what() << endl;
+		return 1;
+	}
 	return 0;
-}
\ No newline at end of file
+}
+
+// Lab2 --replay <file> [--view]
+// Without --view the game is replayed headlessly at full speed and checked against the recorded
+// result; with it every battle action is shown and waits for a key.
+int replay(int argc, char** argv) {
+	try {
+		if (argc < 3) throw invalid_argument("usage: Lab2 --replay <file> [--view]");
+		bool withView = argc > 3 && string(argv[3]) == "--view";
+		GameLog log(argv[2]);
+		unique_ptr<KeyboardInput> keyboard;
+		unique_ptr<GameView> display;
+		if (withView) {
+			keyboard.reset(new KeyboardInput());
+			display.reset(new TerminalView(defaultLayout(log.fieldSize, int(log.layouts.size()))));
+		}
+		else display.reset(new NullView());
+		vector<unique_ptr<ReplayGamer>> replayGamers;
+		vector<Gamer*> gamers;
+		for (size_t i = 0; i < log.layouts.size(); ++i) {
+			replayGamers.emplace_back(new ReplayGamer(log, int(i), keyboard.get()));
+			gamers.push_back(replayGamers.back().get());
+		}
+		Game game(display.get(), gamers, log.fieldSize);
+		game.run();
+		display.reset();
+		cout << log.actions.size() << " actions replayed, winner: gamer " << game.getWinnerIndex() + 1 << endl;
+		if (log.finished && log.winnerIndex != game.getWinnerIndex()) {
+			cout << "the replay diverged: the log says gamer " << log.winnerIndex + 1 << " won" << endl;
+			return 1;
+		}
+	}
+	catch (exception& errInfo) {
+		cout << errInfo.what() << endl;
+		return 1;
+	}
+	return 0;
+}
+
+// Lab2 --serve <socket> [--threads N] [--size W H] [--gamers-per-game N]
+// Serves until interrupted and reports what it served.
+int serve(int argc, char** argv) {
+	try {
+		if (argc < 3) throw invalid_argument("usage: Lab2 --serve <socket> [--threads N] [--size W H] [--gamers-per-game N]");
+		unsigned threadCount = thread::hardware_concurrency();
+		COORD fieldSize; fieldSize.X = fieldSize.Y = 10;
+		int gamersPerGame = 2;
+		for (int i = 3; i < argc; ++i) {
+			string option = argv[i];
+			if (option == "--threads" && i + 1 < argc) threadCount = stoul(argv[++i]);
+			else if (option == "--size" && i + 2 < argc) fieldSize = readFieldSize(argv, i);
+			else if (option == "--gamers-per-game" && i + 1 < argc) gamersPerGame = stoi(argv[++i]);
+			else throw invalid_argument("unknown option " + option);
+		}
+		GameServer server(argv[2], threadCount, fieldSize, gamersPerGame);
+		ServerReport report = server.run();
+		cout << report.connections << " connections, " << report.gamesStarted << " games started, " << report.gamesFinished << " finished, "
+			<< report.moves << " moves in " << report.seconds << " s" << endl;
+	}
+	catch (exception& errInfo) {
+		cout << errInfo.what() << endl;
+		return 1;
+	}
+	return 0;
+}
+
+// Lab2 --load-test <socket> [--connections N] [--seconds S] [--strategy NAME]
+int loadTest(int argc, char** argv) {
+	try {
+		if (argc < 3) throw invalid_argument("usage: Lab2 --load-test <socket> [--connections N] [--seconds S] [--strategy NAME]");
+		int connections = 1000;
+		double seconds = 10;
+		string strategy = "hunt";
+		for (int i = 3; i < argc; ++i) {
+			string option = argv[i];
+			if (option == "--connections" && i + 1 < argc) connections = stoi(argv[++i]);
+			else if (option == "--seconds" && i + 1 < argc) seconds = stod(argv[++i]);
+			else if (option == "--strategy" && i + 1 < argc) strategy = argv[++i];
+			else throw invalid_argument("unknown option " + option);
+		}
+		LoadTestReport report = runLoadTest(argv[2], connections, seconds, strategy);
+		cout << report.moves << " moves in " << report.seconds << " s, " << report.moves / report.seconds << " moves/s, "
+			<< report.gamesFinished << " games finished" << endl;
+		cout << "latency: median " << report.medianLatency << " us, p99 " << report.p99Latency << " us" << endl;
+		if (report.rejected != 0 || report.dropped != 0) cout << report.rejected << " actions rejected, " << report.dropped << " connections dropped" << endl;
+	}
+	catch (exception& errInfo) {
+		cout << errInfo.what() << endl;
+		return 1;
+	}
+	return 0;
+}
+
+// Lab2 --self-test
+int selfTest() {
+	int failed = runSelfTests(cout);
+	if (failed != 0) cout << failed << " self tests failed" << endl;
+	return failed == 0 ? 0 : 1;
+}
+
+// Lab2 [--layout FILE | --size W H] [--gamers GAMER...] [--record FILE] [--profile]
+// A gamer is "human" or a computer strategy; humans share the keyboard. The layout file gives
+// the field size and one field per gamer. --profile prints frame timings and sizes at exit.
+int main(int argc, char** argv) {
+	if (argc > 1 && string(argv[1]) == "--simulate") return simulate(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--replay") return replay(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--serve") return serve(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--load-test") return loadTest(argc, argv);
+	if (argc > 1 && string(argv[1]) == "--self-test") return selfTest();
+	unique_ptr<FrameProfiler> profiler;
+	int exitCode = 0;
+	try {
+		COORD fieldSize; fieldSize.X = fieldSize.Y = 10;
+		vector<string> gamerKinds = { "human", "human" };
+		string layoutPath, recordPath;
+		bool sizeGiven = false, gamersGiven = false;
+		for (int i = 1; i < argc; ++i) {
+			string option = argv[i];
+			if (option == "--layout" && i + 1 < argc) layoutPath = argv[++i];
+			else if (option == "--size" && i + 2 < argc) {
+				fieldSize = readFieldSize(argv, i);
+				sizeGiven = true;
+			}
+			else if (option == "--gamers") {
+				gamerKinds = optionValues(argc, argv, i);
+				gamersGiven = true;
+			}
+			else if (option == "--record" && i + 1 < argc) recordPath = argv[++i];
+			else if (option == "--profile") profiler.reset(new FrameProfiler());
+			else throw invalid_argument("unknown option " + option);
+		}
+		BoardLayout layout;
+		if (layoutPath.empty()) layout = defaultLayout(fieldSize, int(gamerKinds.size()));
+		else {
+			if (sizeGiven) throw invalid_argument("the layout gives the field size, --size is not needed");
+			layout = loadLayout(layoutPath);
+			fieldSize = layout.fieldSize;
+			checkFieldSize(fieldSize);
+			if (!gamersGiven) gamerKinds.assign(layout.fieldPositions.size(), "human");
+			else if (gamerKinds.size() != layout.fieldPositions.size()) throw invalid_argument("the layout has a field for " + to_string(layout.fieldPositions.size()) + " gamers");
+		}
+		KeyboardInput keyboard;
+		vector<unique_ptr<Gamer>> ownedGamers;
+		vector<Gamer*> gamers;
+		random_device seeds;
+		for (size_t i = 0; i < gamerKinds.size(); ++i) {
+			if (gamerKinds[i] == "human") ownedGamers.emplace_back(new Player("P" + to_string(i + 1), fieldSize, keyboard, profiler.get()));
+			else ownedGamers.push_back(createComputer(gamerKinds[i], gamerKinds[i], fieldSize, seeds()));
+			gamers.push_back(ownedGamers.back().get());
+		}
+		unique_ptr<GameRecorder> recorder;
+		if (!recordPath.empty()) recorder.reset(new GameRecorder(recordPath, fieldSize, int(gamers.size())));
+		TerminalView display(layout, profiler.get());
+		Game game(&display, gamers, fieldSize);
+		game.setObserver(recorder.get());
+		game.run();
+	}
+	catch (exception& errInfo) {
+		cout << errInfo.what() << endl;
+		exitCode = 1;
+	}
+	// After the view and the keyboard have given the terminal back
+	if (profiler) profiler->report(cout);
+	return exitCode;
+}
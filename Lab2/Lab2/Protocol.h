@@ -0,0 +1,82 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <stdexcept>
+#include "Game.h"
+#ifdef __linux__
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/resource.h>
+#endif
+
+// Game server protocol. Client and server exchange 4-byte messages over a Unix-domain stream
+// socket; the first byte is the MessageKind, the meaning of the others depends on it.
+// Each connection is one gamer of one game and is closed by the server after MSG_GAME_OVER.
+enum MessageKind {
+	// client: the gamer's next action; ActionType, target X, target Y
+	MSG_ACTION = 1,
+	// server: the game is full and starts; seat of the gamer, field width, field height
+	MSG_START,
+	// server: the gamer's turn begins; GameStage
+	MSG_YOUR_TURN,
+	// server: result of a shot of the gamer; X, Y, ShotOutcome
+	MSG_SHOT,
+	// server: the gamer fires at a new enemy now, MSG_SHOT follows for each shot fired at it so far
+	MSG_ENEMY_CHANGED,
+	// server: an action was handled; 1 if it was the gamer's turn, 1 if the turn goes on
+	MSG_ACK,
+	// server: the game is over; winner seat + 1, 0 if nobody won
+	MSG_GAME_OVER
+};
+
+const int MESSAGE_SIZE = 4;
+
+struct Message {
+	uint8_t bytes[MESSAGE_SIZE];
+	Message(int kind = 0, int first = 0, int second = 0, int third = 0) {
+		bytes[0] = uint8_t(kind);
+		bytes[1] = uint8_t(first);
+		bytes[2] = uint8_t(second);
+		bytes[3] = uint8_t(third);
+	}
+	int kind() const {
+		return bytes[0];
+	}
+	int operator[](int index) const {
+		return bytes[index + 1];
+	}
+};
+
+inline Message actionMessage(const Action& action) {
+	const COORD* cell = action.getTargetCell();
+	return Message(MSG_ACTION, ActionType(action), cell != nullptr ? cell->X : 0, cell != nullptr ? cell->Y : 0);
+}
+
+// Throws runtime_error for a message that is not a valid action
+inline Action messageAction(const Message& message) {
+	if (message.kind() != MSG_ACTION || message[0] > CONFIRM) throw std::runtime_error("not an action message");
+	COORD cell;
+	cell.X = short(message[1]);
+	cell.Y = short(message[2]);
+	return Action(ActionType(message[0]), cell);
+}
+
+#ifdef __linux__
+// Throws runtime_error for a path too long for a socket address
+inline sockaddr_un socketAddress(const std::string& path) {
+	sockaddr_un address = sockaddr_un();
+	if (path.empty() || path.size() >= sizeof(address.sun_path)) throw std::runtime_error("bad socket path " + path);
+	address.sun_family = AF_UNIX;
+	std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+	return address;
+}
+
+// Thousands of connections need more descriptors than the usual soft limit
+inline void raiseDescriptorLimit() {
+	rlimit limit;
+	if (getrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur >= limit.rlim_max) return;
+	limit.rlim_cur = limit.rlim_max;
+	setrlimit(RLIMIT_NOFILE, &limit);
+}
+#endif
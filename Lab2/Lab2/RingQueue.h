@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+
+// First-in first-out queue of at most CAPACITY items kept in place, so it never allocates
+template <class T, size_t CAPACITY>
+class RingQueue {
+	T items[CAPACITY];
+	size_t head;
+	size_t count;
+public:
+	RingQueue() : head(0), count(0) {}
+	bool empty() const {
+		return count == 0;
+	}
+	bool full() const {
+		return count == CAPACITY;
+	}
+	size_t size() const {
+		return count;
+	}
+	// Returns false and leaves the queue as it is if it is full
+	bool push(const T& item) {
+		if (count == CAPACITY) return false;
+		items[(head + count++) % CAPACITY] = item;
+		return true;
+	}
+	// The queue must not be empty
+	T pop() {
+		T item = items[head];
+		head = (head + 1) % CAPACITY;
+		--count;
+		return item;
+	}
+	void clear() {
+		head = count = 0;
+	}
+};
@@ -0,0 +1,228 @@
+#include "SelfTest.h"
+#include "Game.h"
+#include "Computer.h"
+#include "Fleet.h"
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+	// A computer standing in for a human, so that a mixed game can be played without a keyboard
+	class ScriptedHuman : public Gamer {
+		std::unique_ptr<Computer> computer;
+	public:
+		ScriptedHuman(COORD fieldSize, uint64_t seed) : computer(createComputer("hunt", "human", fieldSize, seed, true)) {
+			name = "human";
+		}
+		virtual void act(GameStage stage, ActionQueue& actions) {
+			computer->act(stage, actions);
+		}
+		virtual void shotResult(COORD cell, ShotOutcome outcome) {
+			computer->shotResult(cell, outcome);
+		}
+		virtual void enemyChanged() {
+			computer->enemyChanged();
+		}
+		virtual bool isHuman() const {
+			return true;
+		}
+	};
+
+	// Fails on every frame that would show a computer more of its own fleet than its enemies have shot
+	class LeakCheckingView : public GameView {
+		const std::vector<bool>& human;
+		const int& actingComputer;
+	public:
+		int frames;
+		std::string failure;
+		LeakCheckingView(const std::vector<bool>& human, const int& actingComputer) : human(human), actingComputer(actingComputer), frames(0) {}
+		virtual void update(const std::vector<FieldBoard>& fields, int viewerIndex, int selectedField = -1, const COORD* selectedCell = nullptr) {
+			++frames;
+			if (!failure.empty()) return;
+			if (viewerIndex >= 0 && !human[viewerIndex]) failure = "drawn for computer " + std::to_string(viewerIndex);
+			else if (actingComputer >= 0 && selectedField == actingComputer && selectedCell != nullptr) failure = "cursor of computer " + std::to_string(actingComputer) + " shown on its own field";
+			for (size_t i = 0; i < fields.size() && failure.empty(); ++i) {
+				FieldBoard shown = int(i) == viewerIndex ? fields[i] : fields[i].enemyView();
+				if (!human[i] && shown.ships.andNot(fields[i].shots).any()) failure = "unshot ships of computer " + std::to_string(i) + " shown";
+			}
+		}
+	};
+
+	bool mixedGameHidesComputerFleets(std::string& failure) {
+		COORD fieldSize;
+		fieldSize.X = fieldSize.Y = 10;
+		for (uint64_t seed = 1; seed <= 20; ++seed) {
+			// Computers before, between and after the humans
+			std::vector<bool> human = { false, true, false, true };
+			int actingComputer = -1;
+			std::vector<std::unique_ptr<Gamer>> owned;
+			std::vector<Gamer*> gamers;
+			for (size_t i = 0; i < human.size(); ++i) {
+				if (human[i]) owned.emplace_back(new ScriptedHuman(fieldSize, seed * 10 + i));
+				else owned.push_back(createComputer("hunt", "computer", fieldSize, seed * 10 + i, true));
+				gamers.push_back(owned.back().get());
+			}
+			LeakCheckingView view(human, actingComputer);
+			Game game(&view, gamers, fieldSize);
+			game.start();
+			ActionQueue actions;
+			while (!game.isFinished()) {
+				int current = game.getCurrentGamerIndex();
+				actingComputer = human[current] ? -1 : current;
+				if (actions.empty()) gamers[current]->act(game.getStage(), actions);
+				game.play(current, actions.pop());
+				if (game.getCurrentGamerIndex() != current) actions.clear();
+			}
+			if (!view.failure.empty()) {
+				failure = "seed " + std::to_string(seed) + ": " + view.failure;
+				return false;
+			}
+			if (view.frames == 0) {
+				failure = "nothing was drawn";
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Sampled layouts per occupancy check; a cell fails beyond MAX_DEVIATIONS standard errors
+	const int OCCUPANCY_SAMPLES = 200000;
+	const double MAX_DEVIATIONS = 5;
+
+	// Every layout with a ship on each cell, counted by brute force. Ships of one length are
+	// placed in increasing placement order, so each layout is met once.
+	struct Occupancy {
+		double layouts;
+		std::vector<double> cells;
+	};
+
+	void enumerateLayouts(const PlacementTable& table, const FieldMasks& field, const Bitboard& forbidden, const Bitboard& wounded,
+		int* remaining, int previous, const Bitboard& layout, const Bitboard& blocked, Occupancy& result) {
+		int length = MAX_SHIP_LENGTH;
+		while (length > 0 && remaining[length] == 0) --length;
+		if (length == 0) {
+			if (wounded.andNot(layout).any()) return;
+			result.layouts += 1;
+			for (int cell = layout.next(0); cell != -1; cell = layout.next(cell + 1)) result.cells[cell] += 1;
+			return;
+		}
+		// The next ship of the same length comes after the previous one, a shorter one starts anew
+		int from = previous >= 0 && table[previous].length == length ? previous + 1 : table.firstOfLength(length);
+		--remaining[length];
+		for (int index = from; index < table.firstOfLength(length + 1); ++index) {
+			Bitboard ship = table[index].mask();
+			if ((ship & (blocked | forbidden)).any()) continue;
+			enumerateLayouts(table, field, forbidden, wounded, remaining, index, layout | ship, blocked | field.surroundings(ship), result);
+		}
+		++remaining[length];
+	}
+
+	// Compares how often the sampled layouts cover each cell with the exact share of layouts covering it
+	template <class Sample>
+	bool matchesExactOccupancy(COORD fieldSize, const Fleet& fleet, const Bitboard& forbidden, const Bitboard& wounded, Sample sample, std::string& failure) {
+		PlacementTable table(fieldSize);
+		FieldMasks field(fieldSize);
+		int cellCount = fieldSize.X * fieldSize.Y;
+		Occupancy exact = { 0, std::vector<double>(cellCount, 0) };
+		int remaining[MAX_SHIP_LENGTH + 1];
+		for (int length = 0; length <= MAX_SHIP_LENGTH; ++length) remaining[length] = fleet.counts[length];
+		enumerateLayouts(table, field, forbidden, wounded, remaining, -1, Bitboard(), Bitboard(), exact);
+		if (exact.layouts == 0) {
+			failure = "the fleet has no layout";
+			return false;
+		}
+		std::vector<double> sampled(cellCount, 0);
+		std::mt19937_64 random(1);
+		Bitboard layout;
+		for (int i = 0; i < OCCUPANCY_SAMPLES; ++i) {
+			while (!sample(random, layout)) {}
+			if (!isValidFleet(layout, field, fleet.counts) || (layout & forbidden).any() || wounded.andNot(layout).any()) {
+				failure = "an invalid layout was sampled";
+				return false;
+			}
+			for (int cell = layout.next(0); cell != -1; cell = layout.next(cell + 1)) sampled[cell] += 1;
+		}
+		for (int cell = 0; cell < cellCount; ++cell) {
+			double expected = exact.cells[cell] / exact.layouts, observed = sampled[cell] / OCCUPANCY_SAMPLES;
+			double error = std::sqrt(expected * (1 - expected) / OCCUPANCY_SAMPLES);
+			if (error == 0 ? observed != expected : std::fabs(observed - expected) > MAX_DEVIATIONS * error) {
+				failure = "cell " + std::to_string(cell) + " holds a ship in " + std::to_string(observed) + " of the layouts instead of " + std::to_string(expected);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	bool generatedFleetsAreUniform(std::string& failure) {
+		COORD fieldSize;
+		fieldSize.X = fieldSize.Y = 6;
+		Fleet fleet = { { 0, 2, 2, 1, 0 } };
+		FleetGenerator generator(fieldSize, fleet);
+		return matchesExactOccupancy(fieldSize, fleet, Bitboard(), Bitboard(), [&](std::mt19937_64& random, Bitboard& layout) {
+			layout = generator.generate(random);
+			return true;
+		}, failure);
+	}
+
+	// Two misses, and two hits in a row that one ship or two may cover
+	struct ShotField {
+		COORD fieldSize;
+		Fleet fleet;
+		Bitboard forbidden;
+		Bitboard wounded;
+		ShotField() : fleet({ { 0, 2, 1, 1, 0 } }) {
+			fieldSize.X = fieldSize.Y = 6;
+			forbidden.set(1 * 6 + 1);
+			forbidden.set(3 * 6 + 4);
+			wounded.set(2 * 6 + 1);
+			wounded.set(2 * 6 + 3);
+		}
+	};
+
+	bool sampledLayoutsAroundShotsAreUniform(std::string& failure) {
+		ShotField shots;
+		PlacementTable table(shots.fieldSize);
+		LayoutSampler sampler(table, shots.fieldSize, shots.forbidden, shots.wounded, shots.fleet.counts);
+		return matchesExactOccupancy(shots.fieldSize, shots.fleet, shots.forbidden, shots.wounded, [&](std::mt19937_64& random, Bitboard& layout) {
+			return sampler.sample(random, layout);
+		}, failure);
+	}
+
+	bool chainedLayoutsAroundShotsAreUniform(std::string& failure) {
+		ShotField shots;
+		PlacementTable table(shots.fieldSize);
+		LayoutSampler sampler(table, shots.fieldSize, shots.forbidden, shots.wounded, shots.fleet.counts);
+		std::unique_ptr<LayoutChain> chain(new LayoutChain(sampler));
+		return matchesExactOccupancy(shots.fieldSize, shots.fleet, shots.forbidden, shots.wounded, [&](std::mt19937_64& random, Bitboard& layout) {
+			if (!chain->step(random)) return false;
+			layout = chain->layout();
+			return true;
+		}, failure);
+	}
+
+	struct SelfTest {
+		const char* name;
+		bool (*run)(std::string& failure);
+	};
+
+	const SelfTest SELF_TESTS[] = {
+		{ "mixed game hides computer fleets", mixedGameHidesComputerFleets },
+		{ "generated fleets are uniform", generatedFleetsAreUniform },
+		{ "sampled layouts around shots are uniform", sampledLayoutsAroundShotsAreUniform },
+		{ "chained layouts around shots are uniform", chainedLayoutsAroundShotsAreUniform },
+	};
+}
+
+int runSelfTests(std::ostream& out) {
+	int failed = 0;
+	for (const SelfTest& test : SELF_TESTS) {
+		std::string failure;
+		if (test.run(failure)) out << "ok      " << test.name << std::endl;
+		else {
+			out << "FAILED  " << test.name << ": " << failure << std::endl;
+			++failed;
+		}
+	}
+	return failed;
+}
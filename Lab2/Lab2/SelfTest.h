@@ -0,0 +1,6 @@
+#pragma once
+#include <ostream>
+
+// Checks of the game rules and the computers that need no terminal. Prints one line per check
+// and returns the number of failed checks.
+int runSelfTests(std::ostream& out);
@@ -0,0 +1,100 @@
+#include "Simulator.h"
+#include "Computer.h"
+#include <vector>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <exception>
+
+namespace {
+	const long long GAMES_PER_CLAIM = 64;
+
+	// splitmix64: turns consecutive numbers into independent-looking seeds
+	uint64_t mixSeed(uint64_t value) {
+		value += 0x9E3779B97F4A7C15ull;
+		value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+		value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+		return value ^ (value >> 31);
+	}
+}
+
+Simulator::Simulator(const std::vector<std::string>& strategies, COORD fieldSize, uint64_t seed)
+	: strategies(strategies), fieldSize(fieldSize), seed(seed) {
+	if (strategies.size() < 2 || strategies.size() > size_t(MAX_GAMERS)) throw std::invalid_argument("a game needs 2 to " + std::to_string(MAX_GAMERS) + " gamers");
+	// Fail on a bad strategy name before any thread starts
+	for (const std::string& strategy : strategies) createComputer(strategy, strategy, fieldSize, seed);
+}
+
+void Simulator::playGame(long long gameIndex, SimulationReport& report, GameObserver* observer) const {
+	int gamerCount = int(strategies.size());
+	// Seat i is taken by strategy (first + i) % gamerCount
+	int first = int(gameIndex % gamerCount);
+	uint64_t gamerSeed = mixSeed(seed ^ mixSeed(uint64_t(gameIndex)));
+	std::vector<std::unique_ptr<Computer>> computers;
+	std::vector<Gamer*> gamers;
+	for (int seat = 0; seat < gamerCount; ++seat) {
+		const std::string& strategy = strategies[(first + seat) % gamerCount];
+		computers.push_back(createComputer(strategy, strategy, fieldSize, gamerSeed, true));
+		gamers.push_back(computers.back().get());
+		gamerSeed = mixSeed(gamerSeed);
+	}
+	NullView display;
+	Game game(&display, gamers, fieldSize);
+	game.setObserver(observer);
+	game.run();
+	++report.games;
+	int winner = game.getWinnerIndex();
+	if (winner == -1) {
+		++report.draws;
+		return;
+	}
+	int strategy = (first + winner) % gamerCount;
+	++report.wins[strategy];
+	report.winningShots[strategy] += game.getShotCount(winner);
+}
+
+void Simulator::replayGame(long long gameIndex, GameObserver& observer) const {
+	SimulationReport report(strategies.size());
+	playGame(gameIndex, report, &observer);
+}
+
+SimulationReport Simulator::run(long long games, unsigned threadCount) const {
+	if (threadCount == 0) threadCount = 1;
+	SimulationReport total(strategies.size());
+	std::atomic<long long> nextGame(0);
+	std::mutex totalGuard;
+	std::exception_ptr failure;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::vector<std::thread> threads;
+	for (unsigned i = 0; i < threadCount; ++i) {
+		threads.emplace_back([&]() {
+			SimulationReport report(strategies.size());
+			try {
+				for (;;) {
+					long long begin = nextGame.fetch_add(GAMES_PER_CLAIM);
+					if (begin >= games) break;
+					long long end = std::min(begin + GAMES_PER_CLAIM, games);
+					for (long long game = begin; game < end; ++game) playGame(game, report, nullptr);
+				}
+			}
+			catch (...) {
+				std::lock_guard<std::mutex> lock(totalGuard);
+				if (!failure) failure = std::current_exception();
+				nextGame = games;
+			}
+			std::lock_guard<std::mutex> lock(totalGuard);
+			total.games += report.games;
+			total.draws += report.draws;
+			for (size_t strategy = 0; strategy < strategies.size(); ++strategy) {
+				total.wins[strategy] += report.wins[strategy];
+				total.winningShots[strategy] += report.winningShots[strategy];
+			}
+		});
+	}
+	for (std::thread& thread : threads) thread.join();
+	if (failure) std::rethrow_exception(failure);
+	total.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return total;
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "Game.h"
+
+// Totals per strategy, in the order the strategies were given
+struct SimulationReport {
+	long long games;
+	std::vector<long long> wins;
+	// Shots fired in the games each strategy won, for the average shots-to-win
+	std::vector<long long> winningShots;
+	long long draws;
+	double seconds;
+	explicit SimulationReport(size_t strategyCount) : games(0), wins(strategyCount, 0), winningShots(strategyCount, 0), draws(0), seconds(0) {}
+};
+
+// Plays computer-vs-computer games without a view on a pool of threads.
+// The seeds of game i depend only on the base seed and i and the computers are created
+// reproducible, so a report does not depend on the number of threads or on the machine. The strategies take the seats in rotation, so each moves first equally often.
+class Simulator {
+	std::vector<std::string> strategies;
+	COORD fieldSize;
+	uint64_t seed;
+	void playGame(long long gameIndex, SimulationReport& report, GameObserver* observer) const;
+public:
+	// One gamer per strategy, 2 to MAX_GAMERS of them. Throws invalid_argument for a bad strategy or field.
+	Simulator(const std::vector<std::string>& strategies, COORD fieldSize, uint64_t seed);
+	SimulationReport run(long long games, unsigned threadCount) const;
+	// Plays game number gameIndex of a run once more, reporting it to the observer
+	void replayGame(long long gameIndex, GameObserver& observer) const;
+};
@@ -0,0 +1,176 @@
+#include "Terminal.h"
+#include <stdexcept>
+#ifdef _WIN32
+#include <cstdio>
+#else
+#include <termios.h>
+#include <unistd.h>
+#include <cerrno>
+#include <csignal>
+#endif
+
+Key KeyboardInput::readKey() {
+	Key key;
+	readKeys(&key, 1);
+	return key;
+}
+
+#ifdef _WIN32
+
+namespace {
+	const int RECORD_BATCH = 64;
+}
+
+KeyboardInput::KeyboardInput() {}
+
+int KeyboardInput::readKeys(Key* keys, int capacity) {
+	HANDLE inputHandle = GetStdHandle(STD_INPUT_HANDLE);
+	INPUT_RECORD records[RECORD_BATCH];
+	DWORD recordsRead;
+	for (;;) {
+		// Blocks until there are events, then takes all of them that fit; each gives at most one key
+		if (!ReadConsoleInput(inputHandle, records, DWORD(capacity < RECORD_BATCH ? capacity : RECORD_BATCH), &recordsRead)) throw std::runtime_error("keyboard input closed");
+		int count = 0;
+		for (DWORD i = 0; i < recordsRead; ++i) {
+			if (records[i].EventType != KEY_EVENT || !records[i].Event.KeyEvent.bKeyDown) continue;
+			switch (records[i].Event.KeyEvent.wVirtualKeyCode) {
+			case 13:
+				keys[count++] = KEY_ENTER;
+				break;
+			case 32:
+				keys[count++] = KEY_SPACE;
+				break;
+			case 37:
+				keys[count++] = KEY_LEFT;
+				break;
+			case 38:
+				keys[count++] = KEY_UP;
+				break;
+			case 39:
+				keys[count++] = KEY_RIGHT;
+				break;
+			case 40:
+				keys[count++] = KEY_DOWN;
+				break;
+			}
+		}
+		if (count > 0) return count;
+	}
+}
+
+KeyboardInput::~KeyboardInput() {}
+
+void writeToTerminal(const std::string& data) {
+	fwrite(data.data(), 1, data.length(), stdout);
+	fflush(stdout);
+}
+
+#else
+
+namespace {
+	const int RESTORING_SIGNALS[] = { SIGINT, SIGTERM, SIGHUP, SIGQUIT };
+	const int RESTORING_SIGNAL_COUNT = int(sizeof(RESTORING_SIGNALS) / sizeof(RESTORING_SIGNALS[0]));
+	// Terminal mode for the signal handler: a signal that ends the process skips the destructor
+	termios modeToRestore;
+	struct sigaction previousActions[RESTORING_SIGNAL_COUNT];
+
+	void restoreTerminal(int signalNumber) {
+		tcsetattr(STDIN_FILENO, TCSANOW, &modeToRestore);
+		const char showCursor[] = "\x1b[?25h\n";
+		ssize_t ignored = write(STDOUT_FILENO, showCursor, sizeof(showCursor) - 1);
+		(void)ignored;
+		signal(signalNumber, SIG_DFL);
+		raise(signalNumber);
+	}
+}
+
+// Ctrl-C and Ctrl-\ arrive as keys rather than signals, so that quitting unwinds the game
+KeyboardInput::KeyboardInput() : rawMode(false) {
+	if (tcgetattr(STDIN_FILENO, &savedMode) != 0) return;
+	termios mode = savedMode;
+	mode.c_lflag &= ~(ICANON | ECHO | ISIG);
+	mode.c_iflag &= ~(IXON | ICRNL);
+	mode.c_cc[VMIN] = 1;
+	mode.c_cc[VTIME] = 0;
+	rawMode = tcsetattr(STDIN_FILENO, TCSANOW, &mode) == 0;
+	if (!rawMode) return;
+	modeToRestore = savedMode;
+	struct sigaction action = {};
+	action.sa_handler = restoreTerminal;
+	sigemptyset(&action.sa_mask);
+	for (int i = 0; i < RESTORING_SIGNAL_COUNT; ++i) sigaction(RESTORING_SIGNALS[i], &action, &previousActions[i]);
+}
+
+// Decodes the next key of the bytes already read, skipping the ones that are not keys
+bool KeyboardInput::nextPendingKey(Key& key) {
+	while (!pending.empty()) {
+		char c = pending[0];
+		if (c == '\x1b') {
+			// Arrow keys arrive as ESC [ X or ESC O X in a single read
+			if (pending.length() < 3) {
+				pending.erase(0, 1);
+				continue;
+			}
+			char code = pending[2];
+			pending.erase(0, 3);
+			switch (code) {
+			case 'A':
+				key = KEY_UP;
+				return true;
+			case 'B':
+				key = KEY_DOWN;
+				return true;
+			case 'C':
+				key = KEY_RIGHT;
+				return true;
+			case 'D':
+				key = KEY_LEFT;
+				return true;
+			}
+			continue;
+		}
+		pending.erase(0, 1);
+		switch (c) {
+		case '\x03': case '\x1c':
+			throw std::runtime_error("game interrupted");
+		case '\r': case '\n':
+			key = KEY_ENTER;
+			return true;
+		case ' ':
+			key = KEY_SPACE;
+			return true;
+		}
+	}
+	return false;
+}
+
+int KeyboardInput::readKeys(Key* keys, int capacity) {
+	for (;;) {
+		int count = 0;
+		while (count < capacity && nextPendingKey(keys[count])) ++count;
+		if (count > 0) return count;
+		char buffer[64];
+		ssize_t bytesRead = read(STDIN_FILENO, buffer, sizeof(buffer));
+		if (bytesRead < 0 && errno == EINTR) continue;
+		if (bytesRead <= 0) throw std::runtime_error("keyboard input closed");
+		pending.append(buffer, size_t(bytesRead));
+	}
+}
+
+KeyboardInput::~KeyboardInput() {
+	if (!rawMode) return;
+	for (int i = 0; i < RESTORING_SIGNAL_COUNT; ++i) sigaction(RESTORING_SIGNALS[i], &previousActions[i], nullptr);
+	tcsetattr(STDIN_FILENO, TCSANOW, &savedMode);
+}
+
+void writeToTerminal(const std::string& data) {
+	size_t written = 0;
+	while (written < data.length()) {
+		ssize_t result = write(STDOUT_FILENO, data.data() + written, data.length() - written);
+		if (result < 0 && errno == EINTR) continue;
+		if (result <= 0) return;
+		written += size_t(result);
+	}
+}
+
+#endif
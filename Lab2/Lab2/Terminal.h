@@ -0,0 +1,41 @@
+#pragma once
+#include <string>
+#ifdef _WIN32
+// Keep std::min and std::max usable
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <termios.h>
+// The game uses the Win32 console coordinate type on every platform
+struct COORD {
+	short X;
+	short Y;
+};
+#endif
+
+enum Key { KEY_ENTER, KEY_SPACE, KEY_LEFT, KEY_UP, KEY_RIGHT, KEY_DOWN };
+
+// Blocking keyboard reader. On Windows it reads console input events, elsewhere it switches
+// the terminal to raw mode for its lifetime and decodes ANSI escape sequences.
+class KeyboardInput {
+#ifndef _WIN32
+	std::string pending;
+	bool rawMode;
+	termios savedMode;
+	bool nextPendingKey(Key& key);
+#endif
+public:
+	KeyboardInput();
+	KeyboardInput(const KeyboardInput&) = delete;
+	KeyboardInput& operator=(const KeyboardInput&) = delete;
+	// Throws runtime_error when the input stream is closed
+	Key readKey();
+	// Waits for at least one key, then returns up to capacity keys that are already available
+	// without waiting again. Throws runtime_error when the input stream is closed or, outside
+	// Windows, on Ctrl-C or Ctrl-\, so the game ends through the destructors that restore the terminal.
+	int readKeys(Key* keys, int capacity);
+	~KeyboardInput();
+};
+
+// Writes the whole buffer to the terminal with as few system calls as possible
+void writeToTerminal(const std::string& data);
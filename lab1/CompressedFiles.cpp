@@ -0,0 +1,287 @@
+#include "CompressedFiles.h"
+#include "WorkflowExceptions.h"
+#include <fstream>
+#include <algorithm>
+#include <memory>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#ifdef WORKFLOW_WITH_ZLIB
+#include <zlib.h>
+#endif
+#ifdef WORKFLOW_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+	const size_t CHUNK_SIZE = 1 << 20;
+	const size_t PIPE_CAPACITY = 4;
+
+	class StreamDecoder {
+	public:
+		virtual ~StreamDecoder() {}
+		virtual void decode(const char* data, size_t size, std::string& output) = 0;
+		// Throws if the data stopped in the middle of a stream. No data at all is an empty text
+		// in every format, the way an empty plain file is.
+		virtual void finish() = 0;
+	};
+
+	class StreamEncoder {
+	public:
+		virtual ~StreamEncoder() {}
+		virtual void encode(const char* data, size_t size, bool last, std::string& output) = 0;
+	};
+
+#ifdef WORKFLOW_WITH_ZLIB
+	class GzipDecoder : public StreamDecoder {
+		z_stream stream;
+		bool streamEnded;
+		bool anyInput;
+	public:
+		GzipDecoder() : stream(), streamEnded(false), anyInput(false) {
+			if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK) throw CompressionException("gzip: cannot initialize decoder");
+		}
+		virtual void decode(const char* data, size_t size, std::string& output) {
+			if (size != 0) anyInput = true;
+			stream.next_in = (Bytef*)(data);
+			stream.avail_in = uInt(size);
+			do {
+				// A gzip file may consist of several members written one after another
+				if (streamEnded && stream.avail_in != 0) {
+					inflateReset(&stream);
+					streamEnded = false;
+				}
+				size_t written = output.length();
+				output.resize(written + CHUNK_SIZE);
+				stream.next_out = (Bytef*)(&output[written]);
+				stream.avail_out = uInt(CHUNK_SIZE);
+				int status = inflate(&stream, Z_NO_FLUSH);
+				output.resize(output.length() - stream.avail_out);
+				if (status == Z_STREAM_END) streamEnded = true;
+				else if (status != Z_OK && status != Z_BUF_ERROR) throw CompressionException("gzip: corrupted data");
+			} while (stream.avail_in != 0 || stream.avail_out == 0);
+		}
+		virtual void finish() {
+			if (anyInput && !streamEnded) throw CompressionException("gzip: unexpected end of file");
+		}
+		~GzipDecoder() {
+			inflateEnd(&stream);
+		}
+	};
+
+	class GzipEncoder : public StreamEncoder {
+		z_stream stream;
+	public:
+		GzipEncoder() : stream() {
+			if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+				throw CompressionException("gzip: cannot initialize encoder");
+			}
+		}
+		virtual void encode(const char* data, size_t size, bool last, std::string& output) {
+			stream.next_in = (Bytef*)(data);
+			stream.avail_in = uInt(size);
+			int status;
+			do {
+				size_t written = output.length();
+				output.resize(written + CHUNK_SIZE);
+				stream.next_out = (Bytef*)(&output[written]);
+				stream.avail_out = uInt(CHUNK_SIZE);
+				status = deflate(&stream, last ? Z_FINISH : Z_NO_FLUSH);
+				output.resize(output.length() - stream.avail_out);
+				if (status == Z_STREAM_ERROR) throw CompressionException("gzip: compression failed");
+			} while (stream.avail_out == 0 || (last && status != Z_STREAM_END));
+		}
+		~GzipEncoder() {
+			deflateEnd(&stream);
+		}
+	};
+#endif
+
+#ifdef WORKFLOW_WITH_ZSTD
+	class ZstdDecoder : public StreamDecoder {
+		ZSTD_DCtx* context;
+		// Zero between frames and before any input, so no data at all is an empty text
+		size_t pendingHint;
+	public:
+		ZstdDecoder() : context(ZSTD_createDCtx()), pendingHint(0) {
+			if (context == nullptr) throw CompressionException("zstd: cannot initialize decoder");
+		}
+		virtual void decode(const char* data, size_t size, std::string& output) {
+			ZSTD_inBuffer input = { data, size, 0 };
+			bool outputFull;
+			do {
+				size_t written = output.length();
+				output.resize(written + CHUNK_SIZE);
+				ZSTD_outBuffer buffer = { &output[written], CHUNK_SIZE, 0 };
+				pendingHint = ZSTD_decompressStream(context, &buffer, &input);
+				output.resize(written + buffer.pos);
+				if (ZSTD_isError(pendingHint)) throw CompressionException(std::string("zstd: ") + ZSTD_getErrorName(pendingHint));
+				outputFull = buffer.pos == buffer.size;
+			} while (input.pos < input.size || outputFull);
+		}
+		virtual void finish() {
+			if (pendingHint != 0) throw CompressionException("zstd: unexpected end of file");
+		}
+		~ZstdDecoder() {
+			ZSTD_freeDCtx(context);
+		}
+	};
+
+	class ZstdEncoder : public StreamEncoder {
+		ZSTD_CCtx* context;
+	public:
+		ZstdEncoder() : context(ZSTD_createCCtx()) {
+			if (context == nullptr) throw CompressionException("zstd: cannot initialize encoder");
+		}
+		virtual void encode(const char* data, size_t size, bool last, std::string& output) {
+			ZSTD_inBuffer input = { data, size, 0 };
+			ZSTD_EndDirective mode = last ? ZSTD_e_end : ZSTD_e_continue;
+			for (;;) {
+				size_t written = output.length();
+				output.resize(written + CHUNK_SIZE);
+				ZSTD_outBuffer buffer = { &output[written], CHUNK_SIZE, 0 };
+				size_t remaining = ZSTD_compressStream2(context, &buffer, &input, mode);
+				output.resize(written + buffer.pos);
+				if (ZSTD_isError(remaining)) throw CompressionException(std::string("zstd: ") + ZSTD_getErrorName(remaining));
+				if (last ? remaining == 0 : input.pos == input.size) break;
+			}
+		}
+		~ZstdEncoder() {
+			ZSTD_freeCCtx(context);
+		}
+	};
+#endif
+
+	std::unique_ptr<StreamDecoder> createDecoder(CompressionFormat format) {
+		switch (format) {
+#ifdef WORKFLOW_WITH_ZLIB
+		case GZIP:
+			return std::unique_ptr<StreamDecoder>(new GzipDecoder());
+#endif
+#ifdef WORKFLOW_WITH_ZSTD
+		case ZSTD:
+			return std::unique_ptr<StreamDecoder>(new ZstdDecoder());
+#endif
+		default:
+			throw CompressionException("compression format is not supported by this build");
+		}
+	}
+
+	std::unique_ptr<StreamEncoder> createEncoder(CompressionFormat format) {
+		switch (format) {
+#ifdef WORKFLOW_WITH_ZLIB
+		case GZIP:
+			return std::unique_ptr<StreamEncoder>(new GzipEncoder());
+#endif
+#ifdef WORKFLOW_WITH_ZSTD
+		case ZSTD:
+			return std::unique_ptr<StreamEncoder>(new ZstdEncoder());
+#endif
+		default:
+			throw CompressionException("compression format is not supported by this build");
+		}
+	}
+
+	// Bounded hand-off of raw file chunks from the reading thread to the decompressing one
+	class ChunkPipe {
+		std::mutex guard;
+		std::condition_variable changed;
+		std::deque<std::string> chunks;
+		bool closed;
+		bool aborted;
+	public:
+		ChunkPipe() : closed(false), aborted(false) {}
+		bool push(std::string&& chunk) {
+			std::unique_lock<std::mutex> lock(guard);
+			changed.wait(lock, [this]() { return aborted || chunks.size() < PIPE_CAPACITY; });
+			if (aborted) return false;
+			chunks.push_back(std::move(chunk));
+			changed.notify_all();
+			return true;
+		}
+		bool pop(std::string& chunk) {
+			std::unique_lock<std::mutex> lock(guard);
+			changed.wait(lock, [this]() { return aborted || closed || !chunks.empty(); });
+			if (aborted || chunks.empty()) return false;
+			chunk = std::move(chunks.front());
+			chunks.pop_front();
+			changed.notify_all();
+			return true;
+		}
+		void close() {
+			std::lock_guard<std::mutex> lock(guard);
+			closed = true;
+			changed.notify_all();
+		}
+		void abort() {
+			std::lock_guard<std::mutex> lock(guard);
+			aborted = true;
+			changed.notify_all();
+		}
+	};
+
+	bool endsWith(const std::string& text, const std::string& suffix) {
+		return text.length() >= suffix.length() && text.compare(text.length() - suffix.length(), suffix.length(), suffix) == 0;
+	}
+}
+
+CompressionFormat compressionFormatOf(const std::string& path) {
+	if (endsWith(path, ".gz")) return GZIP;
+	if (endsWith(path, ".zst")) return ZSTD;
+	return PLAIN_TEXT;
+}
+
+void readCompressedFile(const std::string& path, CompressionFormat format, std::string& textStorage) {
+	std::unique_ptr<StreamDecoder> decoder = createDecoder(format);
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) throw FileOpeningException(path);
+	ChunkPipe pipe;
+	std::exception_ptr failure;
+	std::thread decompressor([&]() {
+		try {
+			std::string chunk;
+			while (pipe.pop(chunk)) decoder->decode(chunk.data(), chunk.length(), textStorage);
+			decoder->finish();
+		}
+		catch (...) {
+			failure = std::current_exception();
+			pipe.abort();
+		}
+	});
+	try {
+		for (;;) {
+			std::string chunk(CHUNK_SIZE, '\0');
+			file.read(&chunk[0], CHUNK_SIZE);
+			chunk.resize(size_t(file.gcount()));
+			if (chunk.empty() || !pipe.push(std::move(chunk))) break;
+		}
+	}
+	catch (...) {
+		// A joinable thread must not be destroyed, so stop the decompressor before passing the error on
+		pipe.abort();
+		decompressor.join();
+		throw;
+	}
+	pipe.close();
+	decompressor.join();
+	if (failure) std::rethrow_exception(failure);
+	if (file.bad()) throw FileOpeningException(path);
+}
+
+void writeCompressedFile(const std::string& path, CompressionFormat format, const std::string& textStorage) {
+	std::unique_ptr<StreamEncoder> encoder = createEncoder(format);
+	std::ofstream file(path, std::ios::binary);
+	if (!file.is_open()) throw FileOpeningException(path);
+	std::string compressed;
+	size_t pos = 0;
+	do {
+		size_t size = std::min(CHUNK_SIZE, textStorage.length() - pos);
+		compressed.clear();
+		encoder->encode(textStorage.data() + pos, size, pos + size == textStorage.length(), compressed);
+		file.write(compressed.data(), compressed.length());
+		pos += size;
+	} while (pos < textStorage.length());
+	if (!file) throw FileOpeningException(path);
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <string>
+
+// Transparent compression for readfile, writefile and dump, chosen by file extension:
+// ".gz" is gzip (needs WORKFLOW_WITH_ZLIB and zlib), ".zst" is zstd (needs WORKFLOW_WITH_ZSTD
+// and libzstd). Any other extension is plain text.
+enum CompressionFormat { PLAIN_TEXT, GZIP, ZSTD };
+
+CompressionFormat compressionFormatOf(const std::string& path);
+
+// Reads the file on the calling thread and decompresses it on a separate one,
+// so disk reads and decompression overlap. Appends the result to textStorage.
+void readCompressedFile(const std::string& path, CompressionFormat format, std::string& textStorage);
+
+void writeCompressedFile(const std::string& path, CompressionFormat format, const std::string& textStorage);
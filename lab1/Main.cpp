@@ -6,56 +6,235 @@
 #include <vector>
 #include <stdexcept>
 #include <algorithm>
+#include <set>
+#include <future>
+#include <typeinfo>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <exception>
 #include "WorkflowExceptions.h"
+#include "RegexEngine.h"
+#include "CompressedFiles.h"
+#include "SelfTest.h"
 using namespace std;
 
+// Counts heap allocations for the benchmark report. Counting is switched on by --bench only:
+// otherwise every allocation would go through one shared counter, and an unset flag costs
+// a read of a line no thread writes.
+atomic<bool> countingAllocations(false);
+atomic<size_t> allocationCount(0);
+
+// The replacements pair malloc with free; GCC mistakes that for a mismatch once they are inlined
+#ifdef __GNUC__
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+void* operator new(size_t size) {
+	if (countingAllocations.load(memory_order_relaxed)) allocationCount.fetch_add(1, memory_order_relaxed);
+	void* memory = malloc(size == 0 ? 1 : size);
+	if (memory == nullptr) throw bad_alloc();
+	return memory;
+}
+
+void operator delete(void* memory) noexcept {
+	free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept {
+	free(memory);
+}
+#ifdef __GNUC__
+#pragma GCC diagnostic pop
+#endif
+
+void writeTextFile(const string& path, const string& text) {
+	CompressionFormat format = compressionFormatOf(path);
+	if (format != PLAIN_TEXT) {
+		writeCompressedFile(path, format, text);
+		return;
+	}
+	ofstream file(path);
+	if (!file.is_open()) throw FileOpeningException(path);
+	file << text;
+}
+
+class Worker;
+
+// Writes the files of dump and writefile on a background thread, so the chain goes on while
+// the disk works. Every write hands over an immutable snapshot of the text. New writes queue up
+// in one buffer while the thread drains the other, and at most byteBudget bytes of snapshots
+// wait at once: beyond that write blocks until earlier ones are done.
+class BackgroundWriter {
+	struct PendingWrite {
+		string path;
+		shared_ptr<const string> text;
+		const Worker* origin;
+	};
+	size_t byteBudget;
+	mutex guard;
+	condition_variable changed;
+	vector<PendingWrite> queued;
+	size_t bytesInFlight;
+	bool finishing;
+	thread ioThread;
+	exception_ptr failure;
+	const Worker* failedWorker;
+	void writeQueued() {
+		vector<PendingWrite> writing;
+		unique_lock<mutex> lock(guard);
+		for (;;) {
+			changed.wait(lock, [this]() { return finishing || !queued.empty(); });
+			if (queued.empty()) return;
+			writing.swap(queued);
+			lock.unlock();
+			size_t bytesWritten = 0;
+			exception_ptr writeFailure;
+			const Worker* writeOrigin = nullptr;
+			for (PendingWrite& pending : writing) {
+				try {
+					writeTextFile(pending.path, *pending.text);
+				}
+				catch (...) {
+					if (!writeFailure) {
+						writeFailure = current_exception();
+						writeOrigin = pending.origin;
+					}
+				}
+				bytesWritten += pending.text->length();
+			}
+			writing.clear();
+			lock.lock();
+			if (writeFailure && !failure) {
+				failure = writeFailure;
+				failedWorker = writeOrigin;
+			}
+			bytesInFlight -= bytesWritten;
+			changed.notify_all();
+		}
+	}
+	void stop() {
+		{
+			lock_guard<mutex> lock(guard);
+			finishing = true;
+		}
+		changed.notify_all();
+		if (ioThread.joinable()) ioThread.join();
+	}
+public:
+	BackgroundWriter(size_t byteBudget) : byteBudget(byteBudget), bytesInFlight(0), finishing(false), failedWorker(nullptr) {}
+	BackgroundWriter(const BackgroundWriter&) = delete;
+	BackgroundWriter& operator=(const BackgroundWriter&) = delete;
+	// The thread starts with the first write. A snapshot larger than the budget goes alone.
+	void write(const string& path, shared_ptr<const string> text, const Worker* origin) {
+		unique_lock<mutex> lock(guard);
+		if (!ioThread.joinable()) ioThread = thread(&BackgroundWriter::writeQueued, this);
+		changed.wait(lock, [&]() { return bytesInFlight == 0 || bytesInFlight + text->length() <= byteBudget; });
+		bytesInFlight += text->length();
+		queued.push_back(PendingWrite{ path, move(text), origin });
+		changed.notify_all();
+	}
+	// Waits for every write and rethrows the first error; getFailedWorker tells whose write it was
+	void finish() {
+		stop();
+		if (failure) rethrow_exception(failure);
+	}
+	const Worker* getFailedWorker() const {
+		return failedWorker;
+	}
+	~BackgroundWriter() {
+		stop();
+	}
+};
+
+// Describes a single execution of the workflow: which files the readfile, writefile and
+// dump blocks actually use and how much input was read. During Executor::run the writer
+// takes the files of dump and writefile; without it they are written on the spot.
+class RunContext {
+public:
+	atomic<size_t> bytesRead;
+	BackgroundWriter* writer;
+	RunContext() : bytesRead(0), writer(nullptr) {}
+	virtual ~RunContext() {}
+	virtual string inputPath(const string& scriptPath) const {
+		return scriptPath;
+	}
+	virtual string outputPath(const string& scriptPath) const {
+		return scriptPath;
+	}
+};
+
 class Worker {
 protected:
 	const vector<string> params;
 public:
 	Worker(const vector<string>& params) : params(params) {}
-	virtual void work(string& textStorage) = 0;
+	virtual void work(string& textStorage, RunContext& context) = 0;
+	virtual ~Worker() {}
 };
 
 class Dumper : public Worker {
 public:
 	Dumper(const vector<string>& params) : Worker(params) {}
-	virtual void work(string& textStorage) {
-		ofstream file(params[0]);
-		if (!file.is_open()) throw FileOpeningException(params[0]);
-		file << textStorage;
+	// The chain goes on with textStorage, so the writer gets a copy
+	virtual void work(string& textStorage, RunContext& context) {
+		string path = context.outputPath(params[0]);
+		if (context.writer == nullptr) {
+			writeTextFile(path, textStorage);
+			return;
+		}
+		context.writer->write(path, make_shared<const string>(textStorage), this);
 	}
 };
 
 class FileReader : public Worker {
-	static size_t instanceCount;
 public:
-	FileReader(const vector<string>& params) : Worker(params) {
-		if (++instanceCount > 1) throw RWBlocksNumberException();
-	}
-	virtual void work(string& textStorage) {
-		ifstream file(params[0]);
-		if (!file.is_open()) throw FileOpeningException(params[0]);
+	FileReader(const vector<string>& params) : Worker(params) {}
+	virtual void work(string& textStorage, RunContext& context) {
+		string path = context.inputPath(params[0]);
+		CompressionFormat format = compressionFormatOf(path);
+		if (format != PLAIN_TEXT) {
+			textStorage.clear();
+			readCompressedFile(path, format, textStorage);
+			context.bytesRead += textStorage.length();
+			return;
+		}
+		ifstream file(path);
+		if (!file.is_open()) throw FileOpeningException(path);
 		stringstream buffer;
 		file >> buffer.rdbuf();
 		textStorage = buffer.str();
+		context.bytesRead += textStorage.length();
 	}
 };
-size_t FileReader::instanceCount = 0;
 
 class FileWriter : public Dumper {
-	static size_t instanceCount;
 public:
-	FileWriter(const vector<string>& params) : Dumper(params) {
-		if (++instanceCount > 1) throw RWBlocksNumberException();
+	FileWriter(const vector<string>& params) : Dumper(params) {}
+	// writefile ends its chain, so the text is handed over without a copy
+	virtual void work(string& textStorage, RunContext& context) {
+		if (context.writer == nullptr) {
+			Dumper::work(textStorage, context);
+			return;
+		}
+		context.writer->write(context.outputPath(params[0]), make_shared<const string>(move(textStorage)), this);
+		textStorage.clear();
 	}
 };
-size_t FileWriter::instanceCount = 0;
 
 class GrepWorker : public Worker {
 public:
 	GrepWorker(const vector<string>& params) : Worker(params) {}
-	virtual void work(string& textStorage) {
+	virtual void work(string& textStorage, RunContext&) {
 		string buffer;
 		istringstream oldStorageStream(textStorage);
 		ostringstream newStorageStream;
@@ -79,7 +258,7 @@ public:
 class Sorter : public Worker {
 public:
 	Sorter(const vector<string>& params) : Worker(params) {}
-	virtual void work(string& textStorage) {
+	virtual void work(string& textStorage, RunContext&) {
 		string buffer;
 		istringstream oldStorageStream(textStorage);
 		ostringstream newStorageStream;
@@ -99,40 +278,214 @@ public:
 class Replacer : public Worker {
 public:
 	Replacer(const vector<string>& params) : Worker(params) {}
-	virtual void work(string& textStorage) {
-		for (size_t pos = textStorage.find(params[0]); pos != string::npos; pos = textStorage.find(params[0])) {
-			textStorage.replace(pos, params[0].length(), params[1]);
+	virtual void work(string& textStorage, RunContext&) {
+		if (params[0].empty()) return;
+		string result;
+		size_t copied = 0;
+		for (size_t pos = textStorage.find(params[0]); pos != string::npos; pos = textStorage.find(params[0], copied)) {
+			if (result.empty()) result.reserve(textStorage.length());
+			result.append(textStorage, copied, pos - copied);
+			result += params[1];
+			copied = pos + params[0].length();
+		}
+		if (copied == 0) return;
+		result.append(textStorage, copied, string::npos);
+		textStorage.swap(result);
+	}
+};
+
+// The '\n' ending the line that starts at lineBegin, or textEnd; memchr is far faster than find
+const char* findLineEnd(const char* lineBegin, const char* textEnd) {
+	const void* found = memchr(lineBegin, '\n', textEnd - lineBegin);
+	return found != nullptr ? static_cast<const char*>(found) : textEnd;
+}
+
+class RegexGrepWorker : public Worker {
+	const CompiledRegex pattern;
+public:
+	RegexGrepWorker(const vector<string>& params) : Worker(params), pattern(params[0]) {}
+	virtual void work(string& textStorage, RunContext&) {
+		RegexMatcher matcher(pattern);
+		string result;
+		const char* lineBegin = textStorage.data();
+		const char* textEnd = lineBegin + textStorage.length();
+		bool firstLine = true;
+		for (;;) {
+			const char* lineEnd = findLineEnd(lineBegin, textEnd);
+			if (matcher.search(lineBegin, lineEnd)) {
+				if (!firstLine) result += '\n';
+				result.append(lineBegin, lineEnd);
+				firstLine = false;
+			}
+			if (lineEnd == textEnd) break;
+			lineBegin = lineEnd + 1;
 		}
+		textStorage.swap(result);
+	}
+};
+
+class RegexReplacer : public Worker {
+	const CompiledRegex pattern;
+public:
+	RegexReplacer(const vector<string>& params) : Worker(params), pattern(params[0]) {}
+	virtual void work(string& textStorage, RunContext&) {
+		RegexMatcher matcher(pattern);
+		string result;
+		result.reserve(textStorage.length());
+		const char* lineBegin = textStorage.data();
+		const char* textEnd = lineBegin + textStorage.length();
+		for (;;) {
+			const char* lineEnd = findLineEnd(lineBegin, textEnd);
+			matcher.replaceAll(lineBegin, lineEnd, params[1], result);
+			if (lineEnd == textEnd) break;
+			result += '\n';
+			lineBegin = lineEnd + 1;
+		}
+		textStorage.swap(result);
 	}
 };
 
 class Executor {
-	vector<unsigned int> commands;
-	string textStorage;
+	set<unsigned int> commands;
+	map<unsigned int, vector<unsigned int>> successors;
+	map<unsigned int, unsigned int> predecessors;
+	vector<unsigned int> roots;
+	void pushEdge(unsigned int from, unsigned int to) {
+		auto knownPredecessor = predecessors.find(to);
+		if (knownPredecessor != predecessors.end()) {
+			if (knownPredecessor->second != from) throw GraphStructureException();
+			return;
+		}
+		predecessors[to] = from;
+		successors[from].push_back(to);
+	}
+	// At most this many bytes of dump and writefile snapshots wait for the disk in one run
+	static const size_t WRITE_BUDGET = 64 * 1024 * 1024;
+	// Called from a catch block: rethrows the error being handled as the command's execution error
+	static void rethrowForCommand(unsigned int commandNumber) {
+		try {
+			throw;
+		}
+		catch (FileOpeningException& errInfo) {
+			throw CommandExecutionException(errInfo.what(), commandNumber);
+		}
+		catch (CompressionException& errInfo) {
+			throw CommandExecutionException(errInfo.what(), commandNumber);
+		}
+		catch (exception & errInfo) {
+			throw CommandExecutionException(string("Unexpected:\n") + string(errInfo.what()), commandNumber);
+		}
+		catch (...) {
+			throw CommandExecutionException("Unknown error", commandNumber);
+		}
+	}
+	void executeCommand(unsigned int commandNumber, string& textStorage, map<unsigned int, Worker*>& workerStorage, RunContext& context) const {
+		try {
+			workerStorage.at(commandNumber)->work(textStorage, context);
+		}
+		catch (...) {
+			rethrowForCommand(commandNumber);
+		}
+	}
+	// Runs the command and everything downstream of it. The first successor keeps working on
+	// textStorage in place, every other successor gets its own copy on a separate thread,
+	// so a shared upstream result is computed only once.
+	void runBranch(unsigned int commandNumber, string& textStorage, map<unsigned int, Worker*>& workerStorage, RunContext& context) const {
+		executeCommand(commandNumber, textStorage, workerStorage, context);
+		auto next = successors.find(commandNumber);
+		if (next == successors.end()) return;
+		const vector<unsigned int>& branches = next->second;
+		vector<future<void>> forks;
+		for (size_t i = 1; i < branches.size(); ++i) {
+			unsigned int branchStart = branches[i];
+			forks.push_back(async(launch::async, [this, branchStart, &workerStorage, &context](string branchStorage) {
+				runBranch(branchStart, branchStorage, workerStorage, context);
+			}, textStorage));
+		}
+		try {
+			runBranch(branches[0], textStorage, workerStorage, context);
+		}
+		catch (...) {
+			for (future<void>& fork : forks) fork.wait();
+			throw;
+		}
+		for (future<void>& fork : forks) fork.get();
+	}
 public:
-	void pushCommand(unsigned int cNumber) {
-		commands.push_back(cNumber);
+	void pushChain(const vector<unsigned int>& chain) {
+		for (size_t i = 0; i < chain.size(); ++i) {
+			commands.insert(chain[i]);
+			if (i != 0) pushEdge(chain[i - 1], chain[i]);
+		}
 	}
 	void validateCommandList(const map<unsigned int, Worker*>& workerStorage) {
-		if (commands.size() < 2) throw RWBlocksNumberException();
-		if (typeid(*workerStorage.at(commands[0])) != typeid(FileReader) ||
-			typeid(*workerStorage.at(commands[commands.size() - 1 ])) != typeid(FileWriter)) throw RWBlocksNumberException();
-	}
-	void run(map<unsigned int, Worker*>& workerStorage) {
+		if (successors.empty()) throw RWBlocksNumberException();
+		roots.clear();
 		for (unsigned int commandNumber : commands) {
-			try {
-				workerStorage.at(commandNumber)->work(textStorage);
-			}
-			catch (FileOpeningException& errInfo) {
-				throw CommandExecutionException(errInfo.what(), commandNumber);
-			}
-			catch (exception & errInfo) {
-				throw CommandExecutionException(string("Unexpected:\n") + string(errInfo.what()), commandNumber);
-			}
-			catch (...) {
-				throw CommandExecutionException("Unknown error", commandNumber);
+			bool isReader = typeid(*workerStorage.at(commandNumber)) == typeid(FileReader);
+			bool isWriter = typeid(*workerStorage.at(commandNumber)) == typeid(FileWriter);
+			bool hasInput = predecessors.count(commandNumber) != 0;
+			bool hasOutput = successors.count(commandNumber) != 0;
+			if (isReader == hasInput || isWriter == hasOutput) throw RWBlocksNumberException();
+			if (isReader) roots.push_back(commandNumber);
+		}
+		// Every block except readfile has exactly one input, so a block unreachable from
+		// the readfile blocks can only be part of a cycle.
+		size_t reachable = 0;
+		vector<unsigned int> pending = roots;
+		while (!pending.empty()) {
+			unsigned int commandNumber = pending.back();
+			pending.pop_back();
+			++reachable;
+			auto next = successors.find(commandNumber);
+			if (next != successors.end()) pending.insert(pending.end(), next->second.begin(), next->second.end());
+		}
+		if (reachable != commands.size()) throw GraphStructureException();
+	}
+	size_t sourceCount() const {
+		return roots.size();
+	}
+	// Writes of dump and writefile go to a background thread and are waited for at the end,
+	// where a failed one is reported like a failed command
+	void run(map<unsigned int, Worker*>& workerStorage, RunContext& context) const {
+		BackgroundWriter writer(WRITE_BUDGET);
+		context.writer = &writer;
+		try {
+			runSources(workerStorage, context);
+		}
+		catch (...) {
+			context.writer = nullptr;
+			throw;
+		}
+		context.writer = nullptr;
+		try {
+			writer.finish();
+		}
+		catch (...) {
+			for (auto& worker : workerStorage) {
+				if (worker.second == writer.getFailedWorker()) rethrowForCommand(worker.first);
 			}
+			throw;
+		}
+	}
+	void runSources(map<unsigned int, Worker*>& workerStorage, RunContext& context) const {
+		vector<future<void>> sources;
+		for (size_t i = 1; i < roots.size(); ++i) {
+			unsigned int root = roots[i];
+			sources.push_back(async(launch::async, [this, root, &workerStorage, &context]() {
+				string textStorage;
+				runBranch(root, textStorage, workerStorage, context);
+			}));
+		}
+		try {
+			string textStorage;
+			runBranch(roots[0], textStorage, workerStorage, context);
+		}
+		catch (...) {
+			for (future<void>& source : sources) source.wait();
+			throw;
 		}
+		for (future<void>& source : sources) source.get();
 	}
 };
 
@@ -201,6 +554,14 @@ private:
 			vector<string> params = parseWorkerArgs(getRemaining(stream), 2);
 			workerStorage.insert(pair<unsigned int, Worker*>(workerNumber, new Replacer(params)));
 		}
+		else if (buffer.compare("regrep") == 0) {
+			vector<string> params = parseWorkerArgs(getRemaining(stream), 1);
+			workerStorage.insert(pair<unsigned int, Worker*>(workerNumber, new RegexGrepWorker(params)));
+		}
+		else if (buffer.compare("resub") == 0) {
+			vector<string> params = parseWorkerArgs(getRemaining(stream), 2);
+			workerStorage.insert(pair<unsigned int, Worker*>(workerNumber, new RegexReplacer(params)));
+		}
 		else if (buffer.compare("dump") == 0) {
 			vector<string> params = parseWorkerArgs(getRemaining(stream), 1);
 			workerStorage.insert(pair<unsigned int, Worker*>(workerNumber, new Dumper(params)));
@@ -209,6 +570,22 @@ private:
 			throw UnknownCommandException();
 		}
 	}
+	void parseChain(const map<unsigned int, Worker*>& workerStorage, Executor& commandStorage, const string& chainConfig) {
+		istringstream stream(chainConfig);
+		vector<unsigned int> chain;
+		string arrow;
+		stream >> ws;
+		if (stream.eof()) return;
+		for (;;) {
+			unsigned int workerNumber;
+			if (!(stream >> workerNumber)) throw FormatException();
+			if (workerStorage.count(workerNumber) == 0) throw IdentifierNumberException();
+			chain.push_back(workerNumber);
+			if (!(stream >> arrow)) break;
+			if (arrow.compare("->") != 0) throw FormatException();
+		}
+		commandStorage.pushChain(chain);
+	}
 public:
 	Parser(const string& scriptPath) {
 		file.exceptions(ifstream::failbit);
@@ -230,15 +607,10 @@ public:
 				getline(file, buffer);
 				++lineNumber;
 			}
-			++lineNumber;
-			while (!file.eof()) {
-				unsigned int workerNumber;
-				file >> workerNumber;
-				if (workerStorage.count(workerNumber) == 0) throw IdentifierNumberException();
-				commandStorage.pushCommand(workerNumber);
-				file.exceptions(ifstream::goodbit);
-				file >> buffer;
-				file.exceptions(ifstream::badbit);
+			file.exceptions(ifstream::badbit);
+			while (getline(file, buffer)) {
+				++lineNumber;
+				parseChain(workerStorage, commandStorage, buffer);
 			}
 			commandStorage.validateCommandList(workerStorage);
 		}
@@ -256,17 +628,331 @@ public:
 		}
 	}
 };
+string fileName(const string& path) {
+	size_t separator = path.find_last_of("/\\");
+	return separator == string::npos ? path : path.substr(separator + 1);
+}
+
+// Reads input and writes every output next to the other results in outputDirectory:
+// <outputDirectory>/<output name of the input>.<script output name>
+class BatchRunContext : public RunContext {
+	const string& inputFile;
+	const string& outputDirectory;
+	const string& outputName;
+public:
+	BatchRunContext(const string& inputFile, const string& outputDirectory, const string& outputName)
+		: inputFile(inputFile), outputDirectory(outputDirectory), outputName(outputName) {}
+	virtual string inputPath(const string&) const {
+		return inputFile;
+	}
+	virtual string outputPath(const string& scriptPath) const {
+		return outputDirectory + "/" + outputName + "." + fileName(scriptPath);
+	}
+};
+
+// Applies one parsed workflow to many input files on a pool of threads.
+// A failed file is reported and skipped, the rest of the batch keeps going.
+class BatchRunner {
+	const Executor& environment;
+	map<unsigned int, Worker*>& workerStorage;
+	const vector<string>& inputFiles;
+	const string& outputDirectory;
+	atomic<size_t> nextFile;
+	atomic<size_t> bytesRead;
+	vector<string> outputNames;
+	vector<string> failures;
+	double seconds;
+	// An input's outputs are named after its file name. Inputs sharing a file name use their
+	// whole path instead, with the separators replaced. An input whose name is still taken,
+	// e.g. one listed twice, fails instead of overwriting the other's outputs.
+	void nameOutputs() {
+		map<string, size_t> fileNameCounts;
+		for (const string& inputFile : inputFiles) ++fileNameCounts[fileName(inputFile)];
+		map<string, size_t> owners;
+		for (size_t i = 0; i < inputFiles.size(); ++i) {
+			string name = fileName(inputFiles[i]);
+			if (fileNameCounts[name] > 1) {
+				name = inputFiles[i];
+				replace_if(name.begin(), name.end(), [](char c) { return c == '/' || c == '\\' || c == ':'; }, '_');
+			}
+			outputNames[i] = name;
+			auto owner = owners.insert(make_pair(name, i));
+			if (!owner.second) failures[i] = "Outputs would overwrite those of " + inputFiles[owner.first->second];
+		}
+	}
+	void processFiles() {
+		for (size_t index = nextFile++; index < inputFiles.size(); index = nextFile++) {
+			if (!failures[index].empty()) continue;
+			BatchRunContext context(inputFiles[index], outputDirectory, outputNames[index]);
+			try {
+				environment.run(workerStorage, context);
+			}
+			catch (exception& errInfo) {
+				failures[index] = errInfo.what();
+			}
+			bytesRead += context.bytesRead;
+		}
+	}
+public:
+	BatchRunner(const Executor& environment, map<unsigned int, Worker*>& workerStorage, const vector<string>& inputFiles, const string& outputDirectory)
+		: environment(environment), workerStorage(workerStorage), inputFiles(inputFiles), outputDirectory(outputDirectory),
+		nextFile(0), bytesRead(0), outputNames(inputFiles.size()), failures(inputFiles.size()), seconds(0) {}
+	void run(unsigned int threadCount) {
+		nextFile = 0;
+		bytesRead = 0;
+		failures.assign(inputFiles.size(), string());
+		nameOutputs();
+		auto start = chrono::steady_clock::now();
+		vector<thread> pool;
+		for (unsigned int i = 0; i < threadCount; ++i) pool.push_back(thread(&BatchRunner::processFiles, this));
+		for (thread& worker : pool) worker.join();
+		seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	}
+	void report(ostream& os) const {
+		size_t failed = 0;
+		for (size_t i = 0; i < inputFiles.size(); ++i) {
+			if (failures[i].empty()) continue;
+			++failed;
+			os << inputFiles[i] << ": " << failures[i] << endl;
+		}
+		double megabytes = bytesRead / (1024.0 * 1024.0);
+		os << "Files: " << inputFiles.size() << ", failed: " << failed << endl;
+		os << "Read " << megabytes << " MB in " << seconds << " s: "
+			<< (seconds > 0 ? megabytes / seconds : 0) << " MB/s, "
+			<< (seconds > 0 ? inputFiles.size() / seconds : 0) << " files/s" << endl;
+	}
+};
+
+// Synthetic text: lines of random lowercase words with a uniformly distributed length.
+// matchRate is the share of lines that contain MATCH_TOKEN.
+class CorpusGenerator {
+	size_t targetSize;
+	size_t minLineLength;
+	size_t maxLineLength;
+	double matchRate;
+	unsigned int seed;
+public:
+	static const string MATCH_TOKEN;
+	CorpusGenerator(size_t targetSize, size_t minLineLength, size_t maxLineLength, double matchRate, unsigned int seed)
+		: targetSize(targetSize), minLineLength(max(minLineLength, MATCH_TOKEN.length())),
+		maxLineLength(max(maxLineLength, max(minLineLength, MATCH_TOKEN.length()))), matchRate(matchRate), seed(seed) {}
+	string generate() const {
+		mt19937 engine(seed);
+		uniform_int_distribution<size_t> lineLength(minLineLength, maxLineLength);
+		uniform_int_distribution<int> wordLength(2, 9);
+		uniform_int_distribution<int> letter('a', 'z');
+		bernoulli_distribution containsMatch(matchRate);
+		string corpus;
+		corpus.reserve(targetSize + maxLineLength + 1);
+		while (corpus.length() < targetSize) {
+			if (!corpus.empty()) corpus += '\n';
+			size_t lineStart = corpus.length();
+			size_t length = lineLength(engine);
+			for (int word = wordLength(engine); corpus.length() - lineStart < length; --word) {
+				if (word == 0) {
+					corpus += ' ';
+					word = wordLength(engine) + 1;
+				}
+				else {
+					corpus += char(letter(engine));
+				}
+			}
+			if (containsMatch(engine)) {
+				uniform_int_distribution<size_t> offset(0, length - MATCH_TOKEN.length());
+				corpus.replace(lineStart + offset(engine), MATCH_TOKEN.length(), MATCH_TOKEN);
+			}
+		}
+		return corpus;
+	}
+};
+const string CorpusGenerator::MATCH_TOKEN = "needle";
+
+// Times every worker type and a few typical scripts on a generated corpus.
+// Each measurement is the best of repeatCount runs, with the allocations of that run.
+class Benchmark {
+	const string& corpus;
+	int repeatCount;
+	ostream& os;
+	const string corpusFile = "bench_corpus.txt";
+	const string outputFile = "bench_output.txt";
+	const string scriptFile = "bench_script.txt";
+	void measure(const string& name, const function<void()>& prepare, const function<void()>& body) {
+		double bestSeconds = 0;
+		size_t allocations = 0;
+		for (int i = 0; i < repeatCount; ++i) {
+			prepare();
+			size_t allocationsBefore = allocationCount.load();
+			auto start = chrono::steady_clock::now();
+			body();
+			double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+			if (i == 0 || seconds < bestSeconds) {
+				bestSeconds = seconds;
+				allocations = allocationCount.load() - allocationsBefore;
+			}
+		}
+		double megabytes = corpus.length() / (1024.0 * 1024.0);
+		os << name;
+		for (size_t i = name.length(); i < 24; ++i) os << ' ';
+		os << megabytes / bestSeconds << " MB/s\t" << bestSeconds * 1000 << " ms\t" << allocations << " allocations" << endl;
+	}
+	void measureWorker(const string& name, Worker* worker) {
+		string textStorage;
+		RunContext context;
+		measure(name, [&]() { textStorage = corpus; }, [&]() { worker->work(textStorage, context); });
+		delete worker;
+	}
+	void measureScript(const string& name, const string& workers, const string& chains) {
+		{
+			ofstream script(scriptFile);
+			script << "desc" << endl << "0 = readfile " << corpusFile << endl << workers << "csed" << endl << chains;
+		}
+		map<unsigned int, Worker*> workerStorage;
+		Executor environment;
+		Parser(scriptFile).parse(workerStorage, environment);
+		RunContext context;
+		measure(name, []() {}, [&]() { environment.run(workerStorage, context); });
+		for (auto& worker : workerStorage) delete worker.second;
+	}
+public:
+	Benchmark(const string& corpus, int repeatCount, ostream& os) : corpus(corpus), repeatCount(max(repeatCount, 1)), os(os) {}
+	void run() {
+		{
+			ofstream file(corpusFile, ios::binary);
+			file << corpus;
+		}
+		const string& token = CorpusGenerator::MATCH_TOKEN;
+		measureWorker("readfile", new FileReader({ corpusFile }));
+		measureWorker("grep", new GrepWorker({ token }));
+		measureWorker("regrep", new RegexGrepWorker({ "ne{2}dle|[0-9]+" }));
+		measureWorker("sort", new Sorter({}));
+		measureWorker("replace", new Replacer({ token, "pin" }));
+		measureWorker("resub", new RegexReplacer({ "ne{2}dle", "pin" }));
+		measureWorker("dump", new Dumper({ outputFile }));
+		measureWorker("writefile", new FileWriter({ outputFile }));
+#ifdef WORKFLOW_WITH_ZLIB
+		measureWorker("writefile .gz", new FileWriter({ outputFile + ".gz" }));
+		measureWorker("readfile .gz", new FileReader({ outputFile + ".gz" }));
+		remove((outputFile + ".gz").c_str());
+#endif
+#ifdef WORKFLOW_WITH_ZSTD
+		measureWorker("writefile .zst", new FileWriter({ outputFile + ".zst" }));
+		measureWorker("readfile .zst", new FileReader({ outputFile + ".zst" }));
+		remove((outputFile + ".zst").c_str());
+#endif
+		measureScript("script: grep-sort", "1 = grep " + token + "\n2 = sort\n3 = writefile " + outputFile + "\n", "0 -> 1 -> 2 -> 3\n");
+		measureScript("script: replace-grep", "1 = replace " + token + " pin\n2 = grep pin\n3 = writefile " + outputFile + "\n", "0 -> 1 -> 2 -> 3\n");
+		measureScript("script: fan-out", "1 = grep " + token + "\n2 = writefile " + outputFile + "\n3 = resub \"[aeiou]+\" _\n4 = writefile "
+			+ outputFile + ".2\n", "0 -> 1 -> 2\n0 -> 3 -> 4\n");
+		remove(corpusFile.c_str());
+		remove(outputFile.c_str());
+		remove((outputFile + ".2").c_str());
+		remove(scriptFile.c_str());
+	}
+};
+
+// Corpus options shared by --bench and --generate
+CorpusGenerator parseCorpusArguments(int argc, char** argv, int& repeatCount) {
+	size_t targetSize = 16 * 1024 * 1024;
+	size_t minLineLength = 20;
+	size_t maxLineLength = 120;
+	double matchRate = 0.1;
+	unsigned int seed = 1;
+	for (int i = 0; i + 1 < argc; i += 2) {
+		string option(argv[i]);
+		string value(argv[i + 1]);
+		if (option.compare("--size") == 0) targetSize = size_t(stod(value) * 1024 * 1024);
+		else if (option.compare("--min-line") == 0) minLineLength = stoul(value);
+		else if (option.compare("--max-line") == 0) maxLineLength = stoul(value);
+		else if (option.compare("--match-rate") == 0) matchRate = stod(value);
+		else if (option.compare("--seed") == 0) seed = stoul(value);
+		else if (option.compare("--repeat") == 0) repeatCount = stoi(value);
+		else throw invalid_argument("unknown option " + option);
+	}
+	return CorpusGenerator(targetSize, minLineLength, maxLineLength, matchRate, seed);
+}
+
+// Batch arguments: <output directory> followed by input files, "@list" files with one
+// input path per line, and an optional "--threads N".
+void parseBatchArguments(int argc, char** argv, string& outputDirectory, vector<string>& inputFiles, unsigned int& threadCount) {
+	outputDirectory = argv[0];
+	for (int i = 1; i < argc; ++i) {
+		string argument(argv[i]);
+		if (argument.compare("--threads") == 0 && i + 1 < argc) {
+			threadCount = stoul(argv[++i]);
+		}
+		else if (argument[0] == '@') {
+			ifstream list(argument.substr(1));
+			if (!list.is_open()) throw FileOpeningException(argument.substr(1));
+			string path;
+			while (getline(list, path)) {
+				if (!path.empty() && path[path.length() - 1] == '\r') path.erase(path.length() - 1);
+				if (!path.empty()) inputFiles.push_back(path);
+			}
+		}
+		else {
+			inputFiles.push_back(argument);
+		}
+	}
+	if (threadCount == 0) threadCount = 1;
+}
+
 int main(int argc, char** argv) {
-	if (argc != 2) {
+	bool batchMode = argc >= 4 && string(argv[1]).compare("--batch") == 0;
+	bool benchMode = argc >= 2 && string(argv[1]).compare("--bench") == 0;
+	bool generateMode = argc >= 3 && string(argv[1]).compare("--generate") == 0;
+	if (argc == 2 && string(argv[1]).compare("--self-test") == 0) {
+		int failed = runSelfTests(cout);
+		if (failed != 0) cout << failed << " self tests failed" << endl;
+		return failed != 0 ? 1 : 0;
+	}
+	if (argc != 2 && !batchMode && !generateMode && !benchMode) {
 		cout << "Invalid input" << endl;
+		cout << "Usage: lab1 <script>" << endl;
+		cout << "       lab1 --batch <script> <output directory> <input files | @list>... [--threads N]" << endl;
+		cout << "       lab1 --bench [corpus options] [--repeat N]" << endl;
+		cout << "       lab1 --generate <file> [corpus options]" << endl;
+		cout << "       lab1 --self-test" << endl;
+		cout << "Corpus options: --size MB --min-line N --max-line N --match-rate R --seed S" << endl;
 		return 0;
 	}
 	try {
-		Parser parser = Parser(string(argv[1]));
+		if (benchMode || generateMode) {
+			int repeatCount = 3;
+			int optionsStart = benchMode ? 2 : 3;
+			string corpus = parseCorpusArguments(argc - optionsStart, argv + optionsStart, repeatCount).generate();
+			if (benchMode) {
+				countingAllocations.store(true);
+				Benchmark(corpus, repeatCount, cout).run();
+			}
+			else {
+				ofstream file(argv[2], ios::binary);
+				if (!file.is_open()) throw FileOpeningException(argv[2]);
+				file << corpus;
+			}
+			cout << "Done!" << endl;
+			return 0;
+		}
+		Parser parser = Parser(string(argv[batchMode ? 2 : 1]));
 		map<unsigned int, Worker*>workerStorage;
 		Executor environment;
 		parser.parse(workerStorage, environment);
-		environment.run(workerStorage);
+		if (batchMode) {
+			string outputDirectory;
+			vector<string> inputFiles;
+			unsigned int threadCount = thread::hardware_concurrency();
+			parseBatchArguments(argc - 3, argv + 3, outputDirectory, inputFiles, threadCount);
+			if (environment.sourceCount() != 1) {
+				cout << "Batch mode requires exactly one readfile command" << endl;
+				return 0;
+			}
+			BatchRunner batch(environment, workerStorage, inputFiles, outputDirectory);
+			batch.run(threadCount);
+			batch.report(cout);
+		}
+		else {
+			RunContext context;
+			environment.run(workerStorage, context);
+		}
 		cout << "Done!" << endl;
 	}
 	catch (FileOpeningException& errInfo) {
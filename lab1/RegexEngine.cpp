@@ -0,0 +1,557 @@
+#include "RegexEngine.h"
+#include "WorkflowExceptions.h"
+#include <bitset>
+#include <map>
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+const int LazyDfa::UNKNOWN_STATE;
+const size_t LazyDfa::MAX_STATES;
+const size_t LazyDfa::MAX_CACHED_NFA_STATES;
+const int LazyDfa::DEAD_STATE;
+
+namespace {
+	using CharSet = RegexCharSet;
+
+	const int MAX_REPEAT_COUNT = 100;
+	// Counters copy their operand, so a short pattern like (a{100}){100} can still expand to a huge automaton
+	const size_t MAX_NFA_STATES = 10000;
+
+	enum NodeType { EMPTY_NODE, SET_NODE, LINE_START_NODE, LINE_END_NODE, CONCAT_NODE, ALTERNATE_NODE, STAR_NODE, PLUS_NODE, QUEST_NODE };
+
+	struct RegexNode {
+		NodeType type;
+		int set;
+		std::vector<int> children;
+		// Number of NFA states the node expands to
+		size_t nfaSize;
+	};
+
+	class RegexParser {
+		const std::string& pattern;
+		size_t pos;
+		size_t end;
+		int addNode(NodeType type, const std::vector<int>& children = std::vector<int>()) {
+			size_t nfaSize = 0;
+			for (int child : children) nfaSize += nodes[child].nfaSize;
+			if (type == ALTERNATE_NODE) nfaSize += children.size() - 1;
+			else if (type == STAR_NODE || type == PLUS_NODE || type == QUEST_NODE) ++nfaSize;
+			else if (type == LINE_START_NODE || type == LINE_END_NODE) nfaSize = 1;
+			if (nfaSize > MAX_NFA_STATES) throw RegexSyntaxException("pattern is too large");
+			nodes.push_back(RegexNode{ type, -1, children, nfaSize });
+			return int(nodes.size() - 1);
+		}
+		int addSetNode(const CharSet& set) {
+			sets.push_back(set);
+			nodes.push_back(RegexNode{ SET_NODE, int(sets.size() - 1), std::vector<int>(), 1 });
+			return int(nodes.size() - 1);
+		}
+		static unsigned char singleByte(const CharSet& set) {
+			for (int b = 0; b < 256; ++b) {
+				if (set.test(b)) return (unsigned char)(b);
+			}
+			return 0;
+		}
+		CharSet parseEscape() {
+			if (pos >= end) throw RegexSyntaxException("trailing backslash");
+			char c = pattern[pos++];
+			CharSet result;
+			switch (c) {
+			case 'd': case 'D':
+				for (int b = '0'; b <= '9'; ++b) result.set(b);
+				break;
+			case 'w': case 'W':
+				for (int b = 0; b < 256; ++b) {
+					if (isalnum(b) || b == '_') result.set(b);
+				}
+				break;
+			case 's': case 'S':
+				for (char b : std::string(" \t\r\f\v\n")) result.set((unsigned char)(b));
+				break;
+			case 'n':
+				result.set('\n');
+				return result;
+			case 't':
+				result.set('\t');
+				return result;
+			case 'r':
+				result.set('\r');
+				return result;
+			default:
+				if (isalnum((unsigned char)(c))) throw RegexSyntaxException(std::string("unknown escape \\") + c);
+				result.set((unsigned char)(c));
+				return result;
+			}
+			if (isupper((unsigned char)(c))) {
+				result.flip();
+				result.reset('\n');
+			}
+			return result;
+		}
+		unsigned char parseClassByte() {
+			if (pattern[pos] != '\\') return (unsigned char)(pattern[pos++]);
+			++pos;
+			CharSet escaped = parseEscape();
+			if (escaped.count() != 1) throw RegexSyntaxException("invalid character range");
+			return singleByte(escaped);
+		}
+		CharSet parseClass() {
+			CharSet result;
+			bool negated = pos < end && pattern[pos] == '^';
+			if (negated) ++pos;
+			for (bool first = true;; first = false) {
+				if (pos >= end) throw RegexSyntaxException("unterminated character class");
+				if (pattern[pos] == ']' && !first) {
+					++pos;
+					break;
+				}
+				if (pattern[pos] == '\\' && pos + 1 < end && std::string("dDwWsS").find(pattern[pos + 1]) != std::string::npos) {
+					++pos;
+					result |= parseEscape();
+					continue;
+				}
+				unsigned char low = parseClassByte();
+				if (pos + 1 < end && pattern[pos] == '-' && pattern[pos + 1] != ']') {
+					++pos;
+					unsigned char high = parseClassByte();
+					if (high < low) throw RegexSyntaxException("invalid character range");
+					for (int b = low; b <= high; ++b) result.set(b);
+				}
+				else {
+					result.set(low);
+				}
+			}
+			if (negated) {
+				result.flip();
+				result.reset('\n');
+			}
+			return result;
+		}
+		int parseAtom() {
+			char c = pattern[pos++];
+			CharSet set;
+			switch (c) {
+			case '(': {
+				int inner = parseAlternation();
+				if (pos >= end || pattern[pos] != ')') throw RegexSyntaxException("unbalanced parenthesis");
+				++pos;
+				return inner;
+			}
+			case '[':
+				return addSetNode(parseClass());
+			case '.':
+				set.set();
+				set.reset('\n');
+				return addSetNode(set);
+			case '\\':
+				return addSetNode(parseEscape());
+			case '*': case '+': case '?': case '{':
+				throw RegexSyntaxException("nothing to repeat");
+			case '^':
+				return addNode(LINE_START_NODE);
+			case '$':
+				return addNode(LINE_END_NODE);
+			default:
+				set.set((unsigned char)(c));
+				return addSetNode(set);
+			}
+		}
+		int readNumber() {
+			if (pos >= end || !isdigit((unsigned char)(pattern[pos]))) throw RegexSyntaxException("malformed repetition counter");
+			int value = 0;
+			while (pos < end && isdigit((unsigned char)(pattern[pos]))) {
+				value = value * 10 + (pattern[pos++] - '0');
+				if (value > MAX_REPEAT_COUNT) throw RegexSyntaxException("repetition counter is too large");
+			}
+			return value;
+		}
+		int parseCounter(int atom) {
+			int minCount = readNumber();
+			int maxCount = minCount;
+			bool unbounded = false;
+			if (pos < end && pattern[pos] == ',') {
+				++pos;
+				if (pos < end && pattern[pos] == '}') unbounded = true;
+				else maxCount = readNumber();
+			}
+			if (pos >= end || pattern[pos] != '}' || maxCount < minCount) throw RegexSyntaxException("malformed repetition counter");
+			++pos;
+			std::vector<int> items(minCount, atom);
+			if (unbounded) {
+				items.push_back(addNode(STAR_NODE, { atom }));
+			}
+			else if (maxCount > minCount) {
+				// a{0,3} becomes (a(a(a)?)?)? rather than a?a?a?, which keeps the automata small
+				int optional = addNode(QUEST_NODE, { atom });
+				for (int i = minCount + 1; i < maxCount; ++i) {
+					optional = addNode(QUEST_NODE, { addNode(CONCAT_NODE, { atom, optional }) });
+				}
+				items.push_back(optional);
+			}
+			return addNode(CONCAT_NODE, items);
+		}
+		int parseRepetition() {
+			int atom = parseAtom();
+			while (pos < end) {
+				char c = pattern[pos];
+				if (c == '*') atom = addNode(STAR_NODE, { atom });
+				else if (c == '+') atom = addNode(PLUS_NODE, { atom });
+				else if (c == '?') atom = addNode(QUEST_NODE, { atom });
+				else if (c == '{') {
+					++pos;
+					atom = parseCounter(atom);
+					continue;
+				}
+				else break;
+				++pos;
+			}
+			return atom;
+		}
+		int parseConcatenation() {
+			std::vector<int> items;
+			while (pos < end && pattern[pos] != '|' && pattern[pos] != ')') items.push_back(parseRepetition());
+			if (items.size() == 1) return items[0];
+			return addNode(CONCAT_NODE, items);
+		}
+		int parseAlternation() {
+			std::vector<int> branches = { parseConcatenation() };
+			while (pos < end && pattern[pos] == '|') {
+				++pos;
+				branches.push_back(parseConcatenation());
+			}
+			if (branches.size() == 1) return branches[0];
+			return addNode(ALTERNATE_NODE, branches);
+		}
+	public:
+		std::vector<RegexNode> nodes;
+		std::vector<CharSet> sets;
+		RegexParser(const std::string& pattern, size_t begin, size_t end) : pattern(pattern), pos(begin), end(end) {}
+		int parse() {
+			int root = parseAlternation();
+			if (pos != end) throw RegexSyntaxException("unbalanced parenthesis");
+			return root;
+		}
+	};
+
+	// Thompson construction. Built back to front: every node receives the state that follows it.
+	// The reversed automaton accepts the mirrored strings and is used to locate match starts.
+	class NfaBuilder {
+		const std::vector<RegexNode>& nodes;
+		bool reversed;
+		RegexNfa& nfa;
+		int addState(RegexNfaStateType type, int set, int out, int out1) {
+			nfa.states.push_back(RegexNfaState{ type, set, out, out1 });
+			return int(nfa.states.size() - 1);
+		}
+		int build(int nodeIndex, int next) {
+			const RegexNode& node = nodes[nodeIndex];
+			switch (node.type) {
+			case EMPTY_NODE:
+				return next;
+			case SET_NODE:
+				return addState(NFA_CHAR, node.set, next, -1);
+			case LINE_START_NODE:
+				return addState(reversed ? NFA_AT_SCAN_END : NFA_AT_SCAN_START, -1, next, -1);
+			case LINE_END_NODE:
+				return addState(reversed ? NFA_AT_SCAN_START : NFA_AT_SCAN_END, -1, next, -1);
+			case CONCAT_NODE:
+				if (reversed) {
+					for (size_t i = 0; i < node.children.size(); ++i) next = build(node.children[i], next);
+				}
+				else {
+					for (size_t i = node.children.size(); i-- > 0;) next = build(node.children[i], next);
+				}
+				return next;
+			case ALTERNATE_NODE: {
+				int start = build(node.children.back(), next);
+				for (size_t i = node.children.size() - 1; i-- > 0;) {
+					int branch = build(node.children[i], next);
+					start = addState(NFA_SPLIT, -1, branch, start);
+				}
+				return start;
+			}
+			case STAR_NODE: {
+				int loop = addState(NFA_SPLIT, -1, -1, next);
+				int body = build(node.children[0], loop);
+				nfa.states[loop].out = body;
+				return loop;
+			}
+			case PLUS_NODE: {
+				int loop = addState(NFA_SPLIT, -1, -1, next);
+				int body = build(node.children[0], loop);
+				nfa.states[loop].out = body;
+				return body;
+			}
+			case QUEST_NODE: {
+				int body = build(node.children[0], next);
+				return addState(NFA_SPLIT, -1, body, next);
+			}
+			}
+			return next;
+		}
+	public:
+		NfaBuilder(const std::vector<RegexNode>& nodes, bool reversed, RegexNfa& nfa) : nodes(nodes), reversed(reversed), nfa(nfa) {}
+		void build(int root) {
+			nfa.states.clear();
+			int match = addState(NFA_MATCH, -1, -1, -1);
+			nfa.start = build(root, match);
+		}
+	};
+}
+
+LazyDfa::LazyDfa(const RegexNfa& nfa, bool unanchored, const std::vector<RegexCharSet>& sets,
+	const unsigned char* byteClass, int classCount)
+	: nfa(&nfa), unanchored(unanchored), sets(&sets), byteClass(byteClass), classCount(classCount),
+	representative(classCount, -1), leavesRestart(256, 0), onlyLeavingByte(-1), visited(nfa.states.size(), 0) {
+	for (int b = 0; b < 256; ++b) {
+		if (representative[byteClass[b]] == -1) representative[byteClass[b]] = b;
+	}
+	std::vector<int> emptyScanSet;
+	closure(nfa.start, true, true, emptyScanSet);
+	emptyScanAccepting = false;
+	for (int state : emptyScanSet) {
+		if (nfa.states[state].type == NFA_MATCH) emptyScanAccepting = true;
+	}
+	std::fill(visited.begin(), visited.end(), 0);
+	closure(nfa.start, false, false, restartSet);
+	std::sort(restartSet.begin(), restartSet.end());
+	RegexCharSet leaving;
+	if (!unanchored) leaving.set();
+	for (int state : restartSet) {
+		// A restart state that accepts has already matched, so nothing is skipped
+		if (nfa.states[state].type == NFA_MATCH) leaving.set();
+		else if (nfa.states[state].type == NFA_CHAR) leaving |= sets[nfa.states[state].set];
+	}
+	bool single = leaving.count() == 1;
+	for (int b = 0; b < 256; ++b) {
+		leavesRestart[b] = leaving.test(b);
+		if (single && leaving.test(b)) onlyLeavingByte = b;
+	}
+	flush();
+}
+
+const char* LazyDfa::skipInRestart(const char* current, const char* end) const {
+	if (onlyLeavingByte != -1) {
+		const void* found = std::memchr(current, onlyLeavingByte, end - current);
+		return found != nullptr ? static_cast<const char*>(found) : end;
+	}
+	while (current != end && !leavesRestart[(unsigned char)(*current)]) ++current;
+	return current;
+}
+
+const char* LazyDfa::skipInRestartBackward(const char* begin, const char* end) const {
+	while (end != begin && !leavesRestart[(unsigned char)(end[-1])]) --end;
+	return end;
+}
+
+void LazyDfa::closure(int state, bool atScanStart, bool atScanEnd, std::vector<int>& result) {
+	// Iterative, so that long chains of optional states cannot overflow the call stack
+	pending.push_back(state);
+	while (!pending.empty()) {
+		int current = pending.back();
+		pending.pop_back();
+		if (current < 0 || visited[current]) continue;
+		visited[current] = 1;
+		const RegexNfaState& nfaState = nfa->states[current];
+		switch (nfaState.type) {
+		case NFA_SPLIT:
+			pending.push_back(nfaState.out1);
+			pending.push_back(nfaState.out);
+			break;
+		case NFA_AT_SCAN_START:
+			if (atScanStart) pending.push_back(nfaState.out);
+			break;
+		case NFA_AT_SCAN_END:
+			// Whether the scan ends here is not known yet, so the assertion stays in the set
+			if (atScanEnd) pending.push_back(nfaState.out);
+			else result.push_back(current);
+			break;
+		default:
+			result.push_back(current);
+		}
+	}
+}
+
+int LazyDfa::intern(const std::vector<int>& stateSet) {
+	auto found = known.find(stateSet);
+	if (found != known.end()) return found->second;
+	int id = int(stateSets.size());
+	known.insert(std::make_pair(stateSet, id));
+	stateSets.push_back(stateSet);
+	cachedNfaStates += stateSet.size();
+	bool matched = false;
+	std::vector<int> atEndSet;
+	std::fill(visited.begin(), visited.end(), 0);
+	for (int state : stateSet) {
+		if (nfa->states[state].type == NFA_MATCH) matched = true;
+		else if (nfa->states[state].type == NFA_AT_SCAN_END) closure(nfa->states[state].out, false, true, atEndSet);
+	}
+	bool matchedAtEnd = matched;
+	for (int state : atEndSet) {
+		if (nfa->states[state].type == NFA_MATCH) matchedAtEnd = true;
+	}
+	accepting.push_back(matched);
+	acceptingAtEnd.push_back(matchedAtEnd);
+	transitions.resize(stateSets.size() * classCount, UNKNOWN_STATE);
+	return id;
+}
+
+void LazyDfa::flush() {
+	known.clear();
+	stateSets.clear();
+	transitions.clear();
+	accepting.clear();
+	acceptingAtEnd.clear();
+	cachedNfaStates = 0;
+	intern(std::vector<int>());
+	std::fill(transitions.begin(), transitions.end(), DEAD_STATE);
+	std::vector<int> startSet;
+	std::fill(visited.begin(), visited.end(), 0);
+	closure(nfa->start, true, false, startSet);
+	std::sort(startSet.begin(), startSet.end());
+	scanStartState = intern(startSet);
+	laterStartState = intern(restartSet);
+}
+
+int LazyDfa::computeNext(int state, int byteClassIndex) {
+	std::fill(visited.begin(), visited.end(), 0);
+	nextSet.clear();
+	int byte = representative[byteClassIndex];
+	for (int nfaIndex : stateSets[state]) {
+		const RegexNfaState& nfaState = nfa->states[nfaIndex];
+		if (nfaState.type == NFA_CHAR && (*sets)[nfaState.set].test(byte)) closure(nfaState.out, false, false, nextSet);
+	}
+	if (unanchored) {
+		for (int nfaIndex : restartSet) {
+			if (!visited[nfaIndex]) {
+				visited[nfaIndex] = 1;
+				nextSet.push_back(nfaIndex);
+			}
+		}
+	}
+	std::sort(nextSet.begin(), nextSet.end());
+	auto found = known.find(nextSet);
+	int target;
+	if (found != known.end()) {
+		target = found->second;
+	}
+	else if (stateSets.size() >= MAX_STATES || cachedNfaStates + nextSet.size() > MAX_CACHED_NFA_STATES) {
+		// The caller continues from the returned state; every other cached state is gone
+		flush();
+		return intern(nextSet);
+	}
+	else {
+		target = intern(nextSet);
+	}
+	transitions[state * classCount + byteClassIndex] = target;
+	return target;
+}
+
+CompiledRegex::CompiledRegex(const std::string& pattern) {
+	RegexParser parser(pattern, 0, pattern.length());
+	int root = parser.parse();
+
+	// Bytes that no character set tells apart share a column in the transition tables.
+	std::fill(byteClass, byteClass + 256, 0);
+	classCount = 1;
+	for (const CharSet& set : parser.sets) {
+		std::map<std::pair<int, bool>, int> refined;
+		for (int b = 0; b < 256; ++b) {
+			auto key = std::make_pair(int(byteClass[b]), set.test(b));
+			auto found = refined.insert(std::make_pair(key, int(refined.size()))).first;
+			byteClass[b] = (unsigned char)(found->second);
+		}
+		classCount = int(refined.size());
+	}
+
+	sets = parser.sets;
+	NfaBuilder(parser.nodes, false, forward).build(root);
+	NfaBuilder(parser.nodes, true, backward).build(root);
+}
+
+RegexMatcher::RegexMatcher(const CompiledRegex& regex)
+	: searchDfa(regex.forward, true, regex.sets, regex.byteClass, regex.classCount),
+	matchDfa(regex.forward, false, regex.sets, regex.byteClass, regex.classCount),
+	reverseDfa(regex.backward, true, regex.sets, regex.byteClass, regex.classCount) {}
+
+bool RegexMatcher::search(const char* lineBegin, const char* lineEnd) {
+	if (lineBegin == lineEnd) return searchDfa.acceptsEmptyScan();
+	int state = searchDfa.startState(true);
+	if (searchDfa.isAccepting(state)) return true;
+	for (const char* current = lineBegin; current != lineEnd; ++current) {
+		if (state == searchDfa.startState(false)) {
+			current = searchDfa.skipInRestart(current, lineEnd);
+			if (current == lineEnd) break;
+		}
+		state = searchDfa.next(state, *current);
+		if (searchDfa.isAccepting(state)) return true;
+		if (state == LazyDfa::DEAD_STATE) return false;
+	}
+	return searchDfa.isAcceptingAtEnd(state);
+}
+
+size_t RegexMatcher::longestMatchEnd(const char* lineBegin, const char* lineEnd, const char* matchBegin) {
+	// Only reached for positions where the reverse pass found a match, so an empty one is the fallback
+	if (matchBegin == lineEnd) return lineEnd - lineBegin;
+	int state = matchDfa.startState(matchBegin == lineBegin);
+	const char* last = matchBegin;
+	for (const char* current = matchBegin; current != lineEnd; ++current) {
+		state = matchDfa.next(state, *current);
+		if (state == LazyDfa::DEAD_STATE) return last - lineBegin;
+		if (matchDfa.isAccepting(state)) last = current + 1;
+	}
+	if (matchDfa.isAcceptingAtEnd(state)) last = lineEnd;
+	return last - lineBegin;
+}
+
+void RegexMatcher::replaceAll(const char* lineBegin, const char* lineEnd, const std::string& replacement, std::string& result) {
+	// Most lines hold no match, and the forward search skips far more of them than the passes below
+	if (!search(lineBegin, lineEnd)) {
+		result.append(lineBegin, lineEnd);
+		return;
+	}
+	size_t length = lineEnd - lineBegin;
+	// One backward pass marks every position where some match begins
+	matchStarts.assign(length + 1, 0);
+	if (length == 0) {
+		matchStarts[0] = reverseDfa.acceptsEmptyScan();
+	}
+	else {
+		int state = reverseDfa.startState(true);
+		matchStarts[length] = reverseDfa.isAccepting(state);
+		for (size_t i = length; i-- > 0;) {
+			if (state == reverseDfa.startState(false)) {
+				// The skipped positions keep the state, which does not accept before the scan ends
+				size_t skipped = reverseDfa.skipInRestartBackward(lineBegin, lineBegin + i + 1) - lineBegin;
+				if (skipped == 0) {
+					matchStarts[0] = reverseDfa.isAcceptingAtEnd(state);
+					break;
+				}
+				i = skipped - 1;
+			}
+			state = reverseDfa.next(state, lineBegin[i]);
+			if (state == LazyDfa::DEAD_STATE) break;
+			// The reversed '^' holds where the backward scan ends
+			matchStarts[i] = reverseDfa.isAccepting(state) || (i == 0 && reverseDfa.isAcceptingAtEnd(state));
+		}
+	}
+	size_t copied = 0;
+	for (size_t pos = 0; pos <= length;) {
+		size_t start = pos;
+		while (start <= length && !matchStarts[start]) ++start;
+		if (start > length) break;
+		size_t end = longestMatchEnd(lineBegin, lineEnd, lineBegin + start);
+		result.append(lineBegin + copied, lineBegin + start);
+		result += replacement;
+		if (end == start) {
+			if (start < length) result += lineBegin[start];
+			copied = std::min(start + 1, length);
+			pos = start + 1;
+		}
+		else {
+			copied = pos = end;
+		}
+	}
+	result.append(lineBegin + copied, lineEnd);
+}
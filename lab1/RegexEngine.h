@@ -0,0 +1,126 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <map>
+#include <bitset>
+
+// Regular expression compiled into Thompson automata at construction time.
+// Supported syntax: literals, '.', [...] classes, \d \w \s (and negations), grouping,
+// '|', '*', '+', '?', {m}, {m,}, {m,n}, '^' and '$' (line start and end, wherever they are written).
+// A CompiledRegex never changes after construction, so one instance can be shared between
+// threads; the matching itself is done by a RegexMatcher per thread.
+typedef std::bitset<256> RegexCharSet;
+
+enum RegexNfaStateType { NFA_CHAR, NFA_SPLIT, NFA_MATCH, NFA_AT_SCAN_START, NFA_AT_SCAN_END };
+
+// The scan assertions hold where the automaton starts and ends reading: '^' and '$' in the
+// forward automaton, '$' and '^' in the reversed one
+struct RegexNfaState {
+	RegexNfaStateType type;
+	int set;
+	int out;
+	int out1;
+};
+
+struct RegexNfa {
+	std::vector<RegexNfaState> states;
+	int start;
+};
+
+class CompiledRegex {
+	friend class RegexMatcher;
+	unsigned char byteClass[256];
+	int classCount;
+	std::vector<RegexCharSet> sets;
+	RegexNfa forward;
+	RegexNfa backward;
+public:
+	// Throws RegexSyntaxException for a malformed pattern or one whose automaton would be too large
+	explicit CompiledRegex(const std::string& pattern);
+};
+
+// Deterministic automaton built from an NFA while it runs, like RE2's: a transition is computed
+// the first time it is taken and cached. The cache holds at most MAX_STATES states of at most
+// MAX_CACHED_NFA_STATES NFA states in total and is flushed when it is full, so patterns with huge
+// DFAs such as e.{16} cost time, never memory.
+class LazyDfa {
+	static const int UNKNOWN_STATE = -1;
+	static const size_t MAX_STATES = 2000;
+	static const size_t MAX_CACHED_NFA_STATES = 1 << 18;
+	const RegexNfa* nfa;
+	bool unanchored;
+	const std::vector<RegexCharSet>* sets;
+	const unsigned char* byteClass;
+	int classCount;
+	std::vector<int> representative;
+	// Closure of the NFA start away from the scan start, added at every position when unanchored
+	std::vector<int> restartSet;
+	// Bytes on which the unanchored automaton may leave the restart state; the only one, or -1
+	std::vector<char> leavesRestart;
+	int onlyLeavingByte;
+	std::map<std::vector<int>, int> known;
+	std::vector<std::vector<int>> stateSets;
+	std::vector<int> transitions;
+	std::vector<char> accepting;
+	std::vector<char> acceptingAtEnd;
+	size_t cachedNfaStates;
+	int scanStartState;
+	int laterStartState;
+	bool emptyScanAccepting;
+	// Scratch space of the subset construction
+	std::vector<char> visited;
+	std::vector<int> pending;
+	std::vector<int> nextSet;
+	void closure(int state, bool atScanStart, bool atScanEnd, std::vector<int>& result);
+	int intern(const std::vector<int>& stateSet);
+	void flush();
+	int computeNext(int state, int byteClassIndex);
+public:
+	static const int DEAD_STATE = 0;
+	LazyDfa(const RegexNfa& nfa, bool unanchored, const std::vector<RegexCharSet>& sets, const unsigned char* byteClass, int classCount);
+	// Valid until the next call of next, which may flush the cache
+	int startState(bool atScanStart) const {
+		return atScanStart ? scanStartState : laterStartState;
+	}
+	int next(int state, unsigned char byte) {
+		int target = transitions[state * classCount + byteClass[byte]];
+		return target != UNKNOWN_STATE ? target : computeNext(state, byteClass[byte]);
+	}
+	bool isAccepting(int state) const {
+		return accepting[state] != 0;
+	}
+	// Accepting once the scan ends here, which satisfies the pending scan end assertions
+	bool isAcceptingAtEnd(int state) const {
+		return acceptingAtEnd[state] != 0;
+	}
+	// Whether the automaton accepts an empty scan, where both scan assertions hold at once
+	bool acceptsEmptyScan() const {
+		return emptyScanAccepting;
+	}
+	// From startState(false) of an unanchored automaton, every byte the pattern cannot read first
+	// leads back to startState(false), so a scan in that state skips to the first byte that may
+	// not, or to end: with memchr when a single byte can, which is most literal patterns
+	const char* skipInRestart(const char* current, const char* end) const;
+	// The same for a backward scan of [begin, end): the end of the skipped bytes, or begin
+	const char* skipInRestartBackward(const char* begin, const char* end) const;
+};
+
+// Matches lines against a CompiledRegex. Matching never backtracks: every byte of the input is
+// looked up in a transition table at most once per automaton pass, and runs of bytes no match can
+// begin with are skipped. On the 16 MB --bench corpus regrep runs about as fast as grep (630 and
+// 650 MB/s) and resub at 620 MB/s, less than half the 1450 of replace, which searches the whole
+// text at once instead of line by line. A matcher caches automaton states, so it is used by one
+// thread at a time, and refers to its CompiledRegex, which must outlive it.
+class RegexMatcher {
+	LazyDfa searchDfa;
+	LazyDfa matchDfa;
+	LazyDfa reverseDfa;
+	std::vector<char> matchStarts;
+	size_t longestMatchEnd(const char* lineBegin, const char* lineEnd, const char* matchBegin);
+public:
+	explicit RegexMatcher(const CompiledRegex& regex);
+	// True if some substring of the line matches the pattern.
+	bool search(const char* lineBegin, const char* lineEnd);
+	// Appends the line to the result with every leftmost-longest non-overlapping match replaced.
+	void replaceAll(const char* lineBegin, const char* lineEnd, const std::string& replacement, std::string& result);
+};
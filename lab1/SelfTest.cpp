@@ -0,0 +1,123 @@
+#include "SelfTest.h"
+#include "CompressedFiles.h"
+#include "WorkflowExceptions.h"
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+namespace {
+	const char* const SCRATCH_NAME = "lab1-self-test";
+
+	bool supported(CompressionFormat format) {
+		switch (format) {
+#ifdef WORKFLOW_WITH_ZLIB
+		case GZIP:
+			return true;
+#endif
+#ifdef WORKFLOW_WITH_ZSTD
+		case ZSTD:
+			return true;
+#endif
+		default:
+			return false;
+		}
+	}
+
+	std::string scratchPath(CompressionFormat format) {
+		return std::string(SCRATCH_NAME) + (format == GZIP ? ".gz" : ".zst");
+	}
+
+	void writeRaw(const std::string& path, const std::string& bytes) {
+		std::ofstream file(path, std::ios::binary);
+		if (!file.is_open()) throw FileOpeningException(path);
+		file << bytes;
+	}
+
+	std::string readRaw(const std::string& path) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open()) throw FileOpeningException(path);
+		return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
+	// An empty file is an empty text, as an empty plain file is
+	bool emptyFileIsEmptyText(CompressionFormat format, std::string& failure) {
+		std::string path = scratchPath(format);
+		writeRaw(path, "");
+		std::string text;
+		readCompressedFile(path, format, text);
+		std::remove(path.c_str());
+		if (!text.empty()) failure = "read \"" + text + "\"";
+		return text.empty();
+	}
+
+	bool roundTripKeepsText(CompressionFormat format, std::string& failure) {
+		std::string path = scratchPath(format);
+		std::string original = "first line\nsecond line\n";
+		writeCompressedFile(path, format, original);
+		std::string text;
+		readCompressedFile(path, format, text);
+		std::remove(path.c_str());
+		if (text != original) failure = "read \"" + text + "\"";
+		return text == original;
+	}
+
+	// Only no data at all is empty: data cut short still fails
+	bool truncatedFileFails(CompressionFormat format, std::string& failure) {
+		std::string path = scratchPath(format);
+		writeCompressedFile(path, format, "first line\nsecond line\n");
+		std::string bytes = readRaw(path);
+		writeRaw(path, bytes.substr(0, bytes.length() / 2));
+		std::string text;
+		try {
+			readCompressedFile(path, format, text);
+		}
+		catch (CompressionException&) {
+			std::remove(path.c_str());
+			return true;
+		}
+		std::remove(path.c_str());
+		failure = "no error";
+		return false;
+	}
+
+	struct SelfTest {
+		const char* name;
+		CompressionFormat format;
+		bool (*run)(CompressionFormat format, std::string& failure);
+	};
+
+	const SelfTest SELF_TESTS[] = {
+		{ "empty gzip file is an empty text", GZIP, emptyFileIsEmptyText },
+		{ "empty zstd file is an empty text", ZSTD, emptyFileIsEmptyText },
+		{ "gzip round trip keeps the text", GZIP, roundTripKeepsText },
+		{ "zstd round trip keeps the text", ZSTD, roundTripKeepsText },
+		{ "truncated gzip file fails", GZIP, truncatedFileFails },
+		{ "truncated zstd file fails", ZSTD, truncatedFileFails },
+	};
+}
+
+int runSelfTests(std::ostream& out) {
+	int failed = 0;
+	for (const SelfTest& test : SELF_TESTS) {
+		if (!supported(test.format)) {
+			out << "skipped " << test.name << ": not in this build" << std::endl;
+			continue;
+		}
+		std::string failure;
+		bool passed;
+		try {
+			passed = test.run(test.format, failure);
+		}
+		catch (std::exception& error) {
+			failure = error.what();
+			passed = false;
+		}
+		if (passed) out << "ok      " << test.name << std::endl;
+		else {
+			out << "FAILED  " << test.name << ": " << failure << std::endl;
+			++failed;
+		}
+	}
+	return failed;
+}
@@ -0,0 +1,6 @@
+#pragma once
+#include <ostream>
+
+// Checks of the workflow pieces that need no script. Prints one line per check and returns the
+// number of failed checks; checks of compression formats missing from the build are skipped.
+int runSelfTests(std::ostream& out);
@@ -7,7 +7,11 @@ const char* IdentifierNumberException::what() const noexcept {
 }
 
 const char* RWBlocksNumberException::what() const noexcept {
-	return "Error: there must be exactly one readfile and writefile command";
+	return "Error: every chain must start with readfile and end with writefile command";
+}
+
+const char* GraphStructureException::what() const noexcept {
+	return "Error: every command must have at most one input and chains must not form a cycle";
 }
 
 const char* FormatException::what() const noexcept {
@@ -22,6 +26,13 @@ const char* UnknownCommandException::what() const noexcept {
 	return "Unknown command name";
 }
 
+RegexSyntaxException::RegexSyntaxException(const std::string& desc) {
+	whatToSay = std::string("Invalid regular expression: ") + desc;
+}
+const char* RegexSyntaxException::what() const noexcept {
+	return whatToSay.c_str();
+}
+
 void CommandDefinitionException::createMessage(const std::string& desc, int lineNumber) {
 	std::stringstream buffer;
 	buffer << desc << std::endl << "line: " << lineNumber << std::endl;
@@ -47,6 +58,13 @@ const char* FileOpeningException::what() const noexcept {
 	return whatToSay.c_str();
 }
 
+CompressionException::CompressionException(const std::string& desc) {
+	whatToSay = std::string("Compression error: ") + desc;
+}
+const char* CompressionException::what() const noexcept {
+	return whatToSay.c_str();
+}
+
 void CommandExecutionException::createMessage(const std::string& desc, int commandNumber) {
 	std::stringstream buffer;
 	buffer << desc << std::endl << "command #" << commandNumber << std::endl;
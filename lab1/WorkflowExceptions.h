@@ -17,6 +17,11 @@ public:
 	virtual const char* what() const noexcept;
 };
 
+class GraphStructureException : public SimpleParseException {
+public:
+	virtual const char* what() const noexcept;
+};
+
 class FormatException :public SimpleParseException {
 public:
 	virtual const char* what() const noexcept;
@@ -32,6 +37,13 @@ public:
 	virtual const char* what() const noexcept;
 };
 
+class RegexSyntaxException :public SimpleParseException {
+	std::string whatToSay;
+public:
+	RegexSyntaxException(const std::string& desc);
+	virtual const char* what() const noexcept;
+};
+
 class CommandDefinitionException : public std::exception {
 	std::string whatToSay;
 	void createMessage(const std::string& desc, int lineNumber);
@@ -49,6 +61,13 @@ public:
 	virtual const char* what() const noexcept;
 };
 
+class CompressionException :public std::exception {
+	std::string whatToSay;
+public:
+	CompressionException(const std::string& desc);
+	virtual const char* what() const noexcept;
+};
+
 class CommandExecutionException : public std::exception {
 	std::string whatToSay;
 	void createMessage(const std::string& desc, int commandNumber);